@@ -0,0 +1,621 @@
+//
+// Command line tool for PCs which summarizes serial console logs captured during a test campaign.
+// Reads the logs of TestJitter, StreamingRXTest and PacketThroughputTest, and prints a table with one row per
+// radio config and board revision.  Linux only, e.g.:
+//   g++ -O2 -std=c++17 -pthread CampaignAnalyzer.cpp -o CampaignAnalyzer
+//   ./CampaignAnalyzer [--csv] [--threads N] [--stream-bytes N] [--fec-stream-bytes N] log1.txt [log2.txt ...]
+//
+// Logs are mapped into memory and split into one chunk per thread.  Lines are matched anywhere in the line,
+// so timestamps added by the terminal program don't matter.
+//
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	// Config or board revision which hasn't been seen yet in the chunk, so it comes from the previous chunk
+	const int inherited = -1;
+
+	// Default bytes per stream, matches transmissionLen in StreamingTXTest
+	const size_t defaultStreamBytes = 1280;
+
+	// Default payload bytes per stream with FEC on: 10 blocks of StreamFEC::PAYLOAD_LEN
+	const size_t defaultFECStreamBytes = 960;
+
+	/**
+	 * Radio config and board revision that results belong to
+	 */
+	typedef std::pair<int, int> Context;
+
+	/**
+	 * Results for one context
+	 */
+	struct Results
+	{
+		// TestJitter
+		std::vector<int64_t> roundTripTimes; // ns
+		size_t lostExchanges = 0;
+
+		// StreamingRXTest
+		size_t numStreams = 0;
+		size_t numFECStreams = 0; // streams which were followed by an FEC line, and so only carried FEC payload
+		uint64_t goodBytes = 0;
+		std::vector<float> streamRSSIs;
+		double lqiSum = 0;
+		uint64_t fecBlocks = 0;
+		uint64_t fecCorrectedBytes = 0;
+		uint64_t fecFailedBlocks = 0;
+
+		// PacketThroughputTest
+		size_t numPacketRuns = 0;
+		double bestGoodput = 0; // bps
+		double lossSum = 0; // %
+		double crcFailSum = 0; // %
+
+		void merge(Results && other)
+		{
+			roundTripTimes.insert(roundTripTimes.end(), other.roundTripTimes.begin(), other.roundTripTimes.end());
+			lostExchanges += other.lostExchanges;
+			numStreams += other.numStreams;
+			numFECStreams += other.numFECStreams;
+			goodBytes += other.goodBytes;
+			streamRSSIs.insert(streamRSSIs.end(), other.streamRSSIs.begin(), other.streamRSSIs.end());
+			lqiSum += other.lqiSum;
+			fecBlocks += other.fecBlocks;
+			fecCorrectedBytes += other.fecCorrectedBytes;
+			fecFailedBlocks += other.fecFailedBlocks;
+			numPacketRuns += other.numPacketRuns;
+			bestGoodput = std::max(bestGoodput, other.bestGoodput);
+			lossSum += other.lossSum;
+			crcFailSum += other.crcFailSum;
+		}
+	};
+
+	/**
+	 * State carried from line to line while parsing
+	 */
+	struct ParseState
+	{
+		Context context{inherited, inherited};
+
+		// TestJitter prints the elapsed time even when the exchange timed out, so it has to be skipped.
+		// Empty until the chunk's first exchange line, since the timeout can be at the end of the previous chunk.
+		std::optional<bool> responseTimedOut;
+	};
+
+	/**
+	 * What one thread found in its chunk of the log
+	 */
+	struct ChunkResults
+	{
+		// Keys may contain inherited values, resolved when the chunks are merged in order
+		std::map<Context, Results> results;
+
+		// context at the end of the chunk
+		Context finalContext{inherited, inherited};
+
+		// Elapsed time which came before any timeout line in the chunk, so whether it counts is decided at the merge
+		std::optional<int64_t> leadingRoundTripTime;
+		Context leadingContext{inherited, inherited};
+
+		// whether the last exchange in the chunk timed out, empty if the chunk has no exchange lines
+		std::optional<bool> finalTimedOut;
+	};
+
+	/**
+	 * Parse a number after a prefix in a line.
+	 * @return false if the prefix isn't in the line or isn't followed by a number
+	 */
+	template<typename Value>
+	bool parseAfter(std::string_view line, std::string_view prefix, Value & value, std::string_view * rest = nullptr)
+	{
+		size_t position = line.find(prefix);
+		if(position == std::string_view::npos)
+		{
+			return false;
+		}
+
+		char const * begin = line.data() + position + prefix.size();
+		char const * end = line.data() + line.size();
+		while(begin < end && *begin == ' ')
+		{
+			++begin;
+		}
+
+		std::from_chars_result result = std::from_chars(begin, end, value);
+		if(result.ec != std::errc())
+		{
+			return false;
+		}
+
+		if(rest != nullptr)
+		{
+			*rest = std::string_view(result.ptr, end - result.ptr);
+		}
+		return true;
+	}
+
+	/**
+	 * Handle one line of the log.
+	 */
+	void parseLine(std::string_view line, ParseState & state, ChunkResults & chunk)
+	{
+		Context & context = state.context;
+		std::string_view rest;
+		int intValue;
+
+		// Context lines, from RadioSettingsMenu and the link adaptation
+		if(parseAfter(line, "Running test with config", intValue) || parseAfter(line, "switching to config", intValue)
+			|| parseAfter(line, "Sweeping config", intValue))
+		{
+			context.first = intValue;
+			return;
+		}
+		if(parseAfter(line, "Running test with revision", intValue))
+		{
+			context.second = intValue;
+			return;
+		}
+		if(parseAfter(line, "Using saved config", intValue, &rest))
+		{
+			context.first = intValue;
+			parseAfter(rest, "board revision", context.second);
+			return;
+		}
+
+		// TestJitter
+		int64_t roundTripTime;
+		if(parseAfter(line, "Elapsed time was", roundTripTime))
+		{
+			if(!state.responseTimedOut.has_value())
+			{
+				chunk.leadingRoundTripTime = roundTripTime;
+				chunk.leadingContext = context;
+			}
+			else if(*state.responseTimedOut)
+			{
+				chunk.results[context].lostExchanges++;
+			}
+			else
+			{
+				chunk.results[context].roundTripTimes.push_back(roundTripTime);
+			}
+			state.responseTimedOut = false;
+			return;
+		}
+		if(line.find("Timeout waiting for response") != std::string_view::npos)
+		{
+			state.responseTimedOut = true;
+			return;
+		}
+
+		// StreamingRXTest
+		size_t bytesPosition = line.find(" bytes were successfully received");
+		if(bytesPosition != std::string_view::npos)
+		{
+			// the byte count comes right before
+			size_t numberStart = bytesPosition;
+			while(numberStart > 0 && line[numberStart - 1] >= '0' && line[numberStart - 1] <= '9')
+			{
+				--numberStart;
+			}
+			uint64_t bytes = 0;
+			std::from_chars(line.data() + numberStart, line.data() + bytesPosition, bytes);
+			rest = line.substr(bytesPosition);
+
+			float rssi = 0;
+			float lqi = 0;
+			parseAfter(rest, "average RSSI", rssi);
+			parseAfter(rest, "average LQI", lqi);
+
+			Results & results = chunk.results[context];
+			results.numStreams++;
+			results.goodBytes += bytes;
+			results.streamRSSIs.push_back(rssi);
+			results.lqiSum += lqi;
+			return;
+		}
+		uint64_t fecBlocks;
+		if(parseAfter(line, "FEC:", fecBlocks, &rest))
+		{
+			uint64_t corrected = 0;
+			uint64_t failed = 0;
+			parseAfter(rest, "received,", corrected, &rest);
+			parseAfter(rest, "corrected,", failed);
+
+			// printed right after the stream's byte count, so the last stream had FEC on
+			Results & results = chunk.results[context];
+			results.numFECStreams++;
+			results.fecBlocks += fecBlocks;
+			results.fecCorrectedBytes += corrected;
+			results.fecFailedBlocks += failed;
+			return;
+		}
+
+		// PacketThroughputTest: PKT,config,preamble_bits,payload_len,queue_depth,sent,received,corrupt,loss_pct,crc_fail_pct,packets_per_s,goodput_bps,...
+		size_t pktPosition = line.find("PKT,");
+		if(pktPosition != std::string_view::npos)
+		{
+			const size_t numFields = 11;
+			std::string_view fields = line.substr(pktPosition + 4);
+			double values[numFields];
+			size_t numValues = 0;
+			while(numValues < numFields)
+			{
+				std::from_chars_result result = std::from_chars(fields.data(), fields.data() + fields.size(), values[numValues]);
+				if(result.ec != std::errc())
+				{
+					break;
+				}
+				++numValues;
+				fields.remove_prefix(std::min(fields.size(), static_cast<size_t>(result.ptr - fields.data()) + 1));
+			}
+			if(numValues < numFields)
+			{
+				// the CSV header line
+				return;
+			}
+
+			Results & results = chunk.results[Context(static_cast<int>(values[0]), context.second)];
+			results.numPacketRuns++;
+			results.lossSum += values[7];
+			results.crcFailSum += values[8];
+			results.bestGoodput = std::max(results.bestGoodput, values[10]);
+		}
+	}
+
+	void parseChunk(char const * begin, char const * end, ChunkResults & chunk)
+	{
+		ParseState state;
+
+		while(begin < end)
+		{
+			char const * lineEnd = static_cast<char const *>(memchr(begin, '\n', end - begin));
+			if(lineEnd == nullptr)
+			{
+				lineEnd = end;
+			}
+
+			std::string_view line(begin, lineEnd - begin);
+			if(!line.empty() && line.back() == '\r')
+			{
+				line.remove_suffix(1);
+			}
+			parseLine(line, state, chunk);
+
+			begin = lineEnd + 1;
+		}
+
+		chunk.finalContext = state.context;
+		chunk.finalTimedOut = state.responseTimedOut;
+	}
+
+	/**
+	 * Parse a whole log in parallel, and add its results to the totals.
+	 * @return false if the file couldn't be read
+	 */
+	bool analyzeLog(char const * path, size_t numThreads, std::map<Context, Results> & totals)
+	{
+		int fd = open(path, O_RDONLY);
+		if(fd < 0)
+		{
+			fprintf(stderr, "ERROR: Failed to open %s: %s\n", path, strerror(errno));
+			return false;
+		}
+
+		struct stat fileStat;
+		if(fstat(fd, &fileStat) != 0)
+		{
+			fprintf(stderr, "ERROR: Failed to stat %s: %s\n", path, strerror(errno));
+			close(fd);
+			return false;
+		}
+
+		const size_t fileSize = static_cast<size_t>(fileStat.st_size);
+		if(fileSize == 0)
+		{
+			close(fd);
+			return true;
+		}
+
+		void * mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if(mapping == MAP_FAILED)
+		{
+			fprintf(stderr, "ERROR: Failed to map %s: %s\n", path, strerror(errno));
+			return false;
+		}
+		madvise(mapping, fileSize, MADV_SEQUENTIAL);
+		madvise(mapping, fileSize, MADV_WILLNEED);
+
+		char const * data = static_cast<char const *>(mapping);
+		char const * dataEnd = data + fileSize;
+
+		// split into chunks which end at a line break
+		std::vector<char const *> boundaries{data};
+		for(size_t chunkIndex = 1; chunkIndex < numThreads; ++chunkIndex)
+		{
+			char const * boundary = std::max(boundaries.back(), data + fileSize / numThreads * chunkIndex);
+			char const * lineEnd = static_cast<char const *>(memchr(boundary, '\n', dataEnd - boundary));
+			boundaries.push_back(lineEnd == nullptr ? dataEnd : lineEnd + 1);
+		}
+		boundaries.push_back(dataEnd);
+
+		std::vector<ChunkResults> chunks(numThreads);
+		std::vector<std::thread> threads;
+		for(size_t chunkIndex = 0; chunkIndex < numThreads; ++chunkIndex)
+		{
+			threads.emplace_back(parseChunk, boundaries[chunkIndex], boundaries[chunkIndex + 1], std::ref(chunks[chunkIndex]));
+		}
+		for(std::thread & thread : threads)
+		{
+			thread.join();
+		}
+
+		munmap(mapping, fileSize);
+
+		// Merge in order, filling in the context and timeout state each chunk started with
+		Context context{inherited, inherited};
+		bool responseTimedOut = false;
+		for(ChunkResults & chunk : chunks)
+		{
+			auto resolve = [&](Context const & chunkContext)
+			{
+				return Context(chunkContext.first == inherited ? context.first : chunkContext.first,
+					chunkContext.second == inherited ? context.second : chunkContext.second);
+			};
+
+			if(chunk.leadingRoundTripTime.has_value())
+			{
+				Results & results = totals[resolve(chunk.leadingContext)];
+				if(responseTimedOut)
+				{
+					results.lostExchanges++;
+				}
+				else
+				{
+					results.roundTripTimes.push_back(*chunk.leadingRoundTripTime);
+				}
+			}
+			if(chunk.finalTimedOut.has_value())
+			{
+				responseTimedOut = *chunk.finalTimedOut;
+			}
+
+			for(auto & entry : chunk.results)
+			{
+				totals[resolve(entry.first)].merge(std::move(entry.second));
+			}
+
+			if(chunk.finalContext.first != inherited)
+			{
+				context.first = chunk.finalContext.first;
+			}
+			if(chunk.finalContext.second != inherited)
+			{
+				context.second = chunk.finalContext.second;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * @return The given percentile of the samples, which get partially sorted
+	 */
+	template<typename Value>
+	Value getPercentile(std::vector<Value> & samples, double percentile)
+	{
+		size_t index = static_cast<size_t>(percentile / 100.0 * (samples.size() - 1) + 0.5);
+		std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+		return samples[index];
+	}
+
+	void printResults(std::map<Context, Results> & totals, bool csv, size_t streamBytes, size_t fecStreamBytes)
+	{
+		static char const * const columns[] = {"config", "board", "exchanges", "lost", "rtt_mean_ns", "rtt_p50_ns", "rtt_p90_ns", "rtt_p99_ns",
+			"rtt_std_ns", "jitter_ns", "streams", "ber_pct", "rssi_mean", "rssi_p10", "rssi_min", "lqi_mean",
+			"fec_blocks", "fec_corrected", "fec_failed", "pkt_runs", "pkt_loss_pct", "pkt_crc_fail_pct", "pkt_best_bps"};
+		const size_t numColumns = sizeof(columns) / sizeof(columns[0]);
+		const int width = 14;
+
+		for(size_t column = 0; column < numColumns; ++column)
+		{
+			if(csv)
+			{
+				printf("%s%s", column == 0 ? "" : ",", columns[column]);
+			}
+			else
+			{
+				printf("%*s", column == 0 ? 6 : width, columns[column]);
+			}
+		}
+		printf("\n");
+
+		for(auto & entry : totals)
+		{
+			Results & results = entry.second;
+			std::vector<std::string> cells;
+			char cell[32];
+			auto addCell = [&](char const * format, auto value)
+			{
+				snprintf(cell, sizeof(cell), format, value);
+				cells.push_back(cell);
+			};
+
+			addCell("%d", entry.first.first);
+			addCell("%d", entry.first.second);
+
+			std::vector<int64_t> & rtts = results.roundTripTimes;
+			addCell("%zu", rtts.size() + results.lostExchanges);
+			addCell("%zu", results.lostExchanges);
+			if(rtts.empty())
+			{
+				cells.insert(cells.end(), 6, "-");
+			}
+			else
+			{
+				double sum = 0;
+				for(int64_t rtt : rtts)
+				{
+					sum += rtt;
+				}
+				const double mean = sum / rtts.size();
+				double squareSum = 0;
+				for(int64_t rtt : rtts)
+				{
+					squareSum += (rtt - mean) * (rtt - mean);
+				}
+				// before the percentiles, which reorder the samples
+				auto minMax = std::minmax_element(rtts.begin(), rtts.end());
+				const int64_t jitter = (*minMax.second - *minMax.first) / 2;
+
+				addCell("%.0f", mean);
+				addCell("%" PRIi64, getPercentile(rtts, 50));
+				addCell("%" PRIi64, getPercentile(rtts, 90));
+				addCell("%" PRIi64, getPercentile(rtts, 99));
+				addCell("%.0f", std::sqrt(squareSum / rtts.size()));
+				// same definition as TestJitter: half the spread
+				addCell("%" PRIi64, jitter);
+			}
+
+			addCell("%zu", results.numStreams);
+			if(results.numStreams == 0)
+			{
+				cells.insert(cells.end(), 5, "-");
+			}
+			else
+			{
+				// byte error rate, counting missing bytes as errors.  FEC streams only count their payload.
+				const double expectedBytes = static_cast<double>(results.numStreams - results.numFECStreams) * streamBytes
+					+ static_cast<double>(results.numFECStreams) * fecStreamBytes;
+				addCell("%.3f", 100.0 * std::max(0.0, 1.0 - results.goodBytes / expectedBytes));
+
+				double rssiSum = 0;
+				for(float rssi : results.streamRSSIs)
+				{
+					rssiSum += rssi;
+				}
+				addCell("%.1f", rssiSum / results.streamRSSIs.size());
+				addCell("%.1f", getPercentile(results.streamRSSIs, 10));
+				addCell("%.1f", *std::min_element(results.streamRSSIs.begin(), results.streamRSSIs.end()));
+				addCell("%.1f", results.lqiSum / results.numStreams);
+			}
+
+			addCell("%" PRIu64, results.fecBlocks);
+			addCell("%" PRIu64, results.fecCorrectedBytes);
+			addCell("%" PRIu64, results.fecFailedBlocks);
+
+			addCell("%zu", results.numPacketRuns);
+			if(results.numPacketRuns == 0)
+			{
+				cells.insert(cells.end(), 3, "-");
+			}
+			else
+			{
+				addCell("%.2f", results.lossSum / results.numPacketRuns);
+				addCell("%.2f", results.crcFailSum / results.numPacketRuns);
+				addCell("%.0f", results.bestGoodput);
+			}
+
+			for(size_t column = 0; column < cells.size(); ++column)
+			{
+				if(csv)
+				{
+					printf("%s%s", column == 0 ? "" : ",", cells[column].c_str());
+				}
+				else
+				{
+					printf("%*s", column == 0 ? 6 : width, cells[column].c_str());
+				}
+			}
+			printf("\n");
+		}
+	}
+
+	void printUsage(char const * programName)
+	{
+		fprintf(stderr, "Usage: %s [--csv] [--threads N] [--stream-bytes N] [--fec-stream-bytes N] log1.txt [log2.txt ...]\n", programName);
+		fprintf(stderr, "  --csv                 print CSV instead of a table\n");
+		fprintf(stderr, "  --threads N           number of parsing threads (default: number of cores)\n");
+		fprintf(stderr, "  --stream-bytes N      bytes sent per stream, for the byte error rate (default: %zu)\n", defaultStreamBytes);
+		fprintf(stderr, "  --fec-stream-bytes N  payload bytes sent per stream with FEC on (default: %zu)\n", defaultFECStreamBytes);
+		fprintf(stderr, "A config or board of -1 means the results came before any config or board revision was printed.\n");
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	bool csv = false;
+	size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+	size_t streamBytes = defaultStreamBytes;
+	size_t fecStreamBytes = defaultFECStreamBytes;
+	std::vector<char const *> paths;
+
+	for(int argIndex = 1; argIndex < argc; ++argIndex)
+	{
+		std::string_view arg(argv[argIndex]);
+		if(arg == "--csv")
+		{
+			csv = true;
+		}
+		else if((arg == "--threads" || arg == "--stream-bytes" || arg == "--fec-stream-bytes") && argIndex + 1 < argc)
+		{
+			long value = strtol(argv[++argIndex], nullptr, 10);
+			if(value <= 0)
+			{
+				printUsage(argv[0]);
+				return 1;
+			}
+			size_t & option = arg == "--threads" ? numThreads : (arg == "--stream-bytes" ? streamBytes : fecStreamBytes);
+			option = static_cast<size_t>(value);
+		}
+		else if(arg.substr(0, 2) == "--")
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+		else
+		{
+			paths.push_back(argv[argIndex]);
+		}
+	}
+
+	if(paths.empty())
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	std::map<Context, Results> totals;
+	for(char const * path : paths)
+	{
+		if(!analyzeLog(path, numThreads, totals))
+		{
+			return 1;
+		}
+	}
+
+	printResults(totals, csv, streamBytes, fecStreamBytes);
+	return 0;
+}
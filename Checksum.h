@@ -0,0 +1,28 @@
+//
+// Checksums for data sent to or stored by the test programs.
+//
+
+#ifndef LIGHTSPEEDRANGEFINDER_CHECKSUM_H
+#define LIGHTSPEEDRANGEFINDER_CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * CRC-16/CCITT-FALSE: polynomial 0x1021, initial value 0xFFFF, no reflection.
+ * Pass the previous result as crc to checksum data in several pieces.
+ */
+inline uint16_t crc16CCITT(uint8_t const * data, size_t length, uint16_t crc = 0xFFFF)
+{
+	for(size_t index = 0; index < length; ++index)
+	{
+		crc ^= static_cast<uint16_t>(data[index] << 8);
+		for(size_t bit = 0; bit < 8; ++bit)
+		{
+			crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+		}
+	}
+	return crc;
+}
+
+#endif //LIGHTSPEEDRANGEFINDER_CHECKSUM_H
@@ -0,0 +1,70 @@
+//
+// Estimates the difference between the ground station's and the transponder's crystals, and corrects ranging for it.
+//
+
+#include "ClockDrift.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const float xoscFrequency = 40e6;
+}
+
+ClockDriftEstimator::ClockDriftEstimator(float carrierFrequency, float loDivider, float smoothing):
+carrierFrequency(carrierFrequency),
+hzPerCount(xoscFrequency / (loDivider * (1 << 18))), // frequency offset = FREQOFF_EST * f_xosc / (LO divider * 2^18)
+smoothing(smoothing),
+driftPPM(0),
+minDriftPPM(0),
+maxDriftPPM(0),
+numMeasurements(0)
+{
+}
+
+void ClockDriftEstimator::reset()
+{
+	driftPPM = 0;
+	minDriftPPM = 0;
+	maxDriftPPM = 0;
+	numMeasurements = 0;
+}
+
+int16_t ClockDriftEstimator::readFrequencyOffset(CC1200 & radio)
+{
+	const uint8_t high = radio.readRegister(CC1200::ExtRegister::FREQOFF_EST1);
+	const uint8_t low = radio.readRegister(CC1200::ExtRegister::FREQOFF_EST0);
+	return static_cast<int16_t>((static_cast<uint16_t>(high) << 8) | low);
+}
+
+float ClockDriftEstimator::getOffsetHz(int16_t frequencyOffset) const
+{
+	return frequencyOffset * hzPerCount;
+}
+
+float ClockDriftEstimator::addMeasurement(int16_t frequencyOffset)
+{
+	const float measuredPPM = getOffsetHz(frequencyOffset) / carrierFrequency * 1e6f;
+
+	if(numMeasurements == 0)
+	{
+		driftPPM = measuredPPM;
+		minDriftPPM = measuredPPM;
+		maxDriftPPM = measuredPPM;
+	}
+	else
+	{
+		driftPPM += smoothing * (measuredPPM - driftPPM);
+		minDriftPPM = std::min(minDriftPPM, driftPPM);
+		maxDriftPPM = std::max(maxDriftPPM, driftPPM);
+	}
+	++numMeasurements;
+
+	return measuredPPM;
+}
+
+int64_t ClockDriftEstimator::getCorrection(std::chrono::nanoseconds transponderTime) const
+{
+	return static_cast<int64_t>(std::lround(transponderTime.count() * driftPPM * 1e-6f));
+}
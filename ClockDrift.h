@@ -0,0 +1,105 @@
+//
+// Estimates the difference between the ground station's and the transponder's crystals, and corrects ranging for it.
+//
+
+#ifndef LIGHTSPEEDRANGEFINDER_CLOCKDRIFT_H
+#define LIGHTSPEEDRANGEFINDER_CLOCKDRIFT_H
+
+#include <CC1200.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Tracks the transponder's clock error relative to the ground station, using the CC1200's frequency offset estimate.
+ *
+ * Both radios derive their carrier from their own 40MHz crystal, so the offset the ground station measures on
+ * the transponder's response is the carrier frequency times the difference between the two crystals' errors.
+ * That difference (in ppm) also applies to everything the transponder times with its own clock, i.e. its
+ * turnaround and the preamble and sync word of its response.
+ *
+ * Sign convention: drift is positive when the transponder's crystal runs fast compared to the ground station's.
+ * A fast transponder finishes its turnaround early as seen by the ground station, which shortens the measured
+ * round-trip time, so the correction adds transponderTime * drift to it.
+ *
+ * The offset estimate is noisy, so the drift is smoothed with an exponentially weighted moving average.
+ * Crystals drift slowly (with temperature), so heavy smoothing is fine.
+ *
+ * This assumes that the ground station's MCU timer, which times the round trip, runs off the ground station
+ * radio's 40MHz crystal (or a reference at least as accurate).  Only the transponder's error relative to the
+ * ground station radio is measured, so if the MCU runs from a separate crystal or RC oscillator, its error
+ * scales the whole round-trip time and is not corrected.
+ */
+class ClockDriftEstimator
+{
+public:
+
+	/**
+	 * @param carrierFrequency RF frequency the radios are on, in Hz
+	 * @param loDivider LO divider for the radio's band, 8 for 410-480MHz
+	 * @param smoothing Weight of each new measurement in the moving average, between 0 and 1
+	 */
+	explicit ClockDriftEstimator(float carrierFrequency = 442e6, float loDivider = 8, float smoothing = 0.05f);
+
+	/**
+	 * Forget all measurements.
+	 */
+	void reset();
+
+	/**
+	 * Read the frequency offset estimate of the last packet a radio received (FREQOFF_EST).
+	 * Only valid if frequency offset correction is enabled, which is the chip default.
+	 * @return Raw signed estimate
+	 */
+	static int16_t readFrequencyOffset(CC1200 & radio);
+
+	/**
+	 * Convert a raw frequency offset estimate to Hz.
+	 */
+	float getOffsetHz(int16_t frequencyOffset) const;
+
+	/**
+	 * Add the frequency offset the ground station measured on a response from the transponder.
+	 * @return Drift from this measurement alone, in ppm
+	 */
+	float addMeasurement(int16_t frequencyOffset);
+
+	/**
+	 * @return Whether there's at least one measurement
+	 */
+	bool hasEstimate() const { return numMeasurements > 0; }
+
+	/**
+	 * @return Smoothed drift in ppm, or 0 before the first measurement
+	 */
+	float getDriftPPM() const { return driftPPM; }
+
+	/**
+	 * @return Range of the smoothed drift since reset, to see how much it wanders over a run
+	 */
+	float getMinDriftPPM() const { return minDriftPPM; }
+	float getMaxDriftPPM() const { return maxDriftPPM; }
+
+	size_t getNumMeasurements() const { return numMeasurements; }
+
+	/**
+	 * Get the correction to add to a round-trip time measured by the ground station.
+	 * @param transponderTime Part of the round-trip time which is timed by the transponder's clock
+	 * @return Correction in ns, 0 before the first measurement
+	 */
+	int64_t getCorrection(std::chrono::nanoseconds transponderTime) const;
+
+private:
+
+	float carrierFrequency;
+	float hzPerCount;
+	float smoothing;
+
+	float driftPPM;
+	float minDriftPPM;
+	float maxDriftPPM;
+	size_t numMeasurements;
+};
+
+#endif //LIGHTSPEEDRANGEFINDER_CLOCKDRIFT_H
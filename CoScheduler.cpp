@@ -0,0 +1,210 @@
+//
+// Cooperative scheduler for running several test activities at once on one core, using C++20 coroutines.
+//
+
+#include "CoScheduler.h"
+
+#include <algorithm>
+
+#if defined(__MBED__)
+#include <mbed.h>
+#else
+#include <cstdlib>
+#include <exception>
+#endif
+
+namespace
+{
+	// Frame pool.  Aligned for anything a coroutine frame could hold.
+	alignas(std::max_align_t) uint8_t framePool[CoTask::FRAME_POOL_SLOTS][CoTask::FRAME_SLOT_SIZE];
+	bool frameSlotUsed[CoTask::FRAME_POOL_SLOTS];
+	size_t largestFrameSize = 0;
+}
+
+constexpr size_t CoTask::FRAME_POOL_SLOTS;
+constexpr size_t CoTask::FRAME_SLOT_SIZE;
+
+void * CoTask::promise_type::operator new(size_t size) noexcept
+{
+	largestFrameSize = std::max(largestFrameSize, size);
+
+	if(size > FRAME_SLOT_SIZE)
+	{
+		return nullptr;
+	}
+
+	for(size_t slot = 0; slot < FRAME_POOL_SLOTS; ++slot)
+	{
+		if(!frameSlotUsed[slot])
+		{
+			frameSlotUsed[slot] = true;
+			return framePool[slot];
+		}
+	}
+	return nullptr;
+}
+
+void CoTask::promise_type::operator delete(void * frame, size_t) noexcept
+{
+	const size_t slot = (static_cast<uint8_t *>(frame) - &framePool[0][0]) / FRAME_SLOT_SIZE;
+	frameSlotUsed[slot] = false;
+}
+
+void CoTask::promise_type::unhandled_exception() noexcept
+{
+#if defined(__MBED__)
+	MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_UNKNOWN), "Exception in coroutine task");
+#else
+	std::terminate();
+#endif
+}
+
+CoTask::CoTask(CoTask && other) noexcept:
+handle(other.handle)
+{
+	other.handle = nullptr;
+}
+
+CoTask::~CoTask()
+{
+	// only set if the task never got handed to a scheduler
+	if(handle)
+	{
+		handle.destroy();
+	}
+}
+
+size_t CoTask::getFramesInUse()
+{
+	size_t framesInUse = 0;
+	for(bool used : frameSlotUsed)
+	{
+		framesInUse += used ? 1 : 0;
+	}
+	return framesInUse;
+}
+
+size_t CoTask::getLargestFrameSize()
+{
+	return largestFrameSize;
+}
+
+constexpr size_t CoScheduler::MAX_TASKS;
+
+CoScheduler::CoScheduler():
+tasks(),
+numTasks(0),
+numResumes(0)
+{
+}
+
+CoScheduler::~CoScheduler()
+{
+	for(size_t index = 0; index < numTasks; ++index)
+	{
+		tasks[index].destroy();
+	}
+}
+
+bool CoScheduler::spawn(CoTask && task)
+{
+	if(!task.isValid() || numTasks == MAX_TASKS)
+	{
+		return false;
+	}
+
+	tasks[numTasks++] = task.handle;
+	task.handle = nullptr;
+	return true;
+}
+
+void CoScheduler::run()
+{
+	while(numTasks > 0)
+	{
+		runOnce();
+	}
+}
+
+size_t CoScheduler::runOnce()
+{
+	size_t numResumed = 0;
+	const std::chrono::microseconds currentTime = now();
+
+	for(size_t index = 0; index < numTasks;)
+	{
+		CoTask::Handle task = tasks[index];
+
+		if(isReady(task.promise(), currentTime))
+		{
+			task.promise().waitType = CoTask::WaitType::READY;
+			task.resume();
+			++numResumed;
+			++numResumes;
+		}
+
+		if(task.done())
+		{
+			// swap the last task into this slot, and check that one next
+			task.destroy();
+			tasks[index] = tasks[--numTasks];
+		}
+		else
+		{
+			++index;
+		}
+	}
+
+	return numResumed;
+}
+
+bool CoScheduler::isReady(CoTask::promise_type & promise, std::chrono::microseconds currentTime)
+{
+	promise.timedOut = false;
+
+	switch(promise.waitType)
+	{
+		case CoTask::WaitType::READY:
+			return true;
+
+		case CoTask::WaitType::SLEEP:
+			return currentTime >= promise.deadline;
+
+		case CoTask::WaitType::PREDICATE:
+			if(promise.predicate(promise.predicateContext))
+			{
+				return true;
+			}
+			break;
+
+		case CoTask::WaitType::EVENT:
+			if(promise.event->consume())
+			{
+				return true;
+			}
+			break;
+	}
+
+	if(currentTime >= promise.deadline)
+	{
+		promise.timedOut = true;
+		return true;
+	}
+	return false;
+}
+
+std::chrono::microseconds CoScheduler::now()
+{
+#if defined(__MBED__)
+	static Timer clock;
+	static bool clockStarted = false;
+	if(!clockStarted)
+	{
+		clock.start();
+		clockStarted = true;
+	}
+	return clock.elapsed_time();
+#else
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch());
+#endif
+}
@@ -0,0 +1,296 @@
+//
+// Cooperative scheduler for running several test activities at once on one core, using C++20 coroutines.
+//
+
+#ifndef LIGHTSPEEDRANGEFINDER_COSCHEDULER_H
+#define LIGHTSPEEDRANGEFINDER_COSCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+
+class EventFlag;
+
+/**
+ * A task that can be run by the CoScheduler.  Write a task as a function returning CoTask which uses co_await, e.g.:
+ *
+ *   CoTask blink(DigitalOut & led)
+ *   {
+ *       while(true)
+ *       {
+ *           led = !led;
+ *           co_await sleepFor(500ms);
+ *       }
+ *   }
+ *
+ * Coroutine frames come from a fixed pool instead of the heap.  If the pool is full or the frame is too big,
+ * the task is returned empty and CoScheduler::spawn() refuses it.
+ */
+class CoTask
+{
+public:
+
+	// Frame pool size.  Each frame holds the task's locals that live across a co_await.
+	static constexpr size_t FRAME_POOL_SLOTS = 8;
+	static constexpr size_t FRAME_SLOT_SIZE = 512;
+
+	/**
+	 * What a suspended task is waiting for
+	 */
+	enum class WaitType
+	{
+		READY, // run on the next pass
+		SLEEP, // run once the deadline passes
+		PREDICATE, // run once the predicate returns true, or the deadline passes
+		EVENT // run once the event flag is set, or the deadline passes
+	};
+
+	struct promise_type
+	{
+		WaitType waitType = WaitType::READY;
+		std::chrono::microseconds deadline{0};
+
+		// Predicate for PREDICATE waits.  Function pointer plus context, so no allocation is needed.
+		bool (*predicate)(void *) = nullptr;
+		void * predicateContext = nullptr;
+
+		// Flag for EVENT waits
+		EventFlag * event = nullptr;
+
+		// set by the scheduler when it resumes a task because its deadline passed
+		bool timedOut = false;
+
+		static void * operator new(size_t size) noexcept;
+		static void operator delete(void * frame, size_t size) noexcept;
+		static CoTask get_return_object_on_allocation_failure() noexcept { return CoTask(nullptr); }
+
+		CoTask get_return_object() noexcept { return CoTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+		// The scheduler starts the task, and destroys it once it's finished
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept;
+	};
+
+	typedef std::coroutine_handle<promise_type> Handle;
+
+	CoTask(CoTask && other) noexcept;
+	CoTask(CoTask const &) = delete;
+	CoTask & operator=(CoTask const &) = delete;
+	~CoTask();
+
+	/**
+	 * @return false if the frame couldn't be allocated
+	 */
+	bool isValid() const { return static_cast<bool>(handle); }
+
+	/**
+	 * @return Number of frame pool slots in use
+	 */
+	static size_t getFramesInUse();
+
+	/**
+	 * @return Size of the largest frame allocated so far, to check how much RAM tasks really need
+	 */
+	static size_t getLargestFrameSize();
+
+private:
+	friend class CoScheduler;
+
+	explicit CoTask(Handle handle): handle(handle) {}
+
+	Handle handle;
+};
+
+/**
+ * Flag that a task can wait on.  set() is safe to call from an ISR or radio callback.
+ * Waking a task clears the flag, so each set() wakes one wait.
+ */
+class EventFlag
+{
+public:
+	void set() { flag.store(true); }
+
+	void clear() { flag.store(false); }
+
+	bool isSet() const { return flag.load(); }
+
+	/**
+	 * Clear the flag, and return whether it was set.
+	 */
+	bool consume() { return flag.exchange(false); }
+
+	/**
+	 * Awaitable which waits for the flag to be set.  The co_await returns false if it timed out.
+	 */
+	auto wait(std::chrono::microseconds timeout = std::chrono::microseconds::max());
+
+private:
+	std::atomic<bool> flag{false};
+};
+
+/**
+ * Runs CoTasks round robin.  Tasks only switch at co_await, so code between co_awaits never gets interrupted
+ * by another task, but a task which doesn't co_await holds up all the others.
+ */
+class CoScheduler
+{
+public:
+
+	static constexpr size_t MAX_TASKS = CoTask::FRAME_POOL_SLOTS;
+
+	CoScheduler();
+	~CoScheduler();
+
+	/**
+	 * Add a task.  It starts running on the next pass of run().
+	 * @return false if the task is empty (frame allocation failed) or there are too many tasks
+	 */
+	bool spawn(CoTask && task);
+
+	/**
+	 * Run tasks until all of them have finished.
+	 */
+	void run();
+
+	/**
+	 * Run one pass over the tasks, resuming each one that is ready.
+	 * @return Number of tasks resumed
+	 */
+	size_t runOnce();
+
+	size_t getNumTasks() const { return numTasks; }
+
+	/**
+	 * @return Number of times a task has been resumed, for benchmarking
+	 */
+	uint64_t getNumResumes() const { return numResumes; }
+
+	/**
+	 * @return Current time used for sleeps and timeouts
+	 */
+	static std::chrono::microseconds now();
+
+private:
+	CoTask::Handle tasks[MAX_TASKS];
+	size_t numTasks;
+
+	uint64_t numResumes;
+
+	/**
+	 * Check whether a task is ready to resume, and flag it if it timed out.
+	 */
+	static bool isReady(CoTask::promise_type & promise, std::chrono::microseconds currentTime);
+};
+
+namespace CoAwait
+{
+	/**
+	 * Deadline for a timeout starting now
+	 */
+	inline std::chrono::microseconds deadlineFor(std::chrono::microseconds timeout)
+	{
+		if(timeout == std::chrono::microseconds::max())
+		{
+			return timeout;
+		}
+		return CoScheduler::now() + timeout;
+	}
+
+	struct SleepAwaiter
+	{
+		std::chrono::microseconds deadline;
+
+		bool await_ready() const noexcept { return false; }
+
+		void await_suspend(CoTask::Handle handle) const noexcept
+		{
+			handle.promise().waitType = CoTask::WaitType::SLEEP;
+			handle.promise().deadline = deadline;
+		}
+
+		void await_resume() const noexcept {}
+	};
+
+	template<typename Predicate>
+	struct PredicateAwaiter
+	{
+		Predicate predicate;
+		std::chrono::microseconds deadline;
+		CoTask::promise_type * promise = nullptr;
+
+		static bool callPredicate(void * context)
+		{
+			return static_cast<PredicateAwaiter *>(context)->predicate();
+		}
+
+		bool await_ready() { return predicate(); }
+
+		void await_suspend(CoTask::Handle handle) noexcept
+		{
+			promise = &handle.promise();
+			promise->waitType = CoTask::WaitType::PREDICATE;
+			promise->deadline = deadline;
+			promise->predicate = &callPredicate;
+			promise->predicateContext = this;
+		}
+
+		bool await_resume() const noexcept { return promise == nullptr || !promise->timedOut; }
+	};
+
+	struct EventAwaiter
+	{
+		EventFlag & event;
+		std::chrono::microseconds deadline;
+		CoTask::promise_type * promise = nullptr;
+
+		bool await_ready() noexcept { return event.consume(); }
+
+		void await_suspend(CoTask::Handle handle) noexcept
+		{
+			promise = &handle.promise();
+			promise->waitType = CoTask::WaitType::EVENT;
+			promise->deadline = deadline;
+			promise->event = &event;
+		}
+
+		bool await_resume() const noexcept { return promise == nullptr || !promise->timedOut; }
+	};
+}
+
+/**
+ * Awaitable which suspends the task for the given time.  The timing resolution is one scheduler pass.
+ */
+inline CoAwait::SleepAwaiter sleepFor(std::chrono::microseconds duration)
+{
+	return {CoScheduler::now() + duration};
+}
+
+/**
+ * Awaitable which lets the other tasks run, then continues.
+ */
+inline CoAwait::SleepAwaiter yield()
+{
+	return {std::chrono::microseconds(0)};
+}
+
+/**
+ * Awaitable which suspends the task until the predicate returns true, e.g. a FIFO level or GPIO check.
+ * The predicate is polled once per scheduler pass.  The co_await returns false if it timed out.
+ */
+template<typename Predicate>
+CoAwait::PredicateAwaiter<Predicate> waitUntil(Predicate predicate, std::chrono::microseconds timeout = std::chrono::microseconds::max())
+{
+	return {predicate, CoAwait::deadlineFor(timeout)};
+}
+
+inline auto EventFlag::wait(std::chrono::microseconds timeout)
+{
+	return CoAwait::EventAwaiter{*this, CoAwait::deadlineFor(timeout)};
+}
+
+#endif //LIGHTSPEEDRANGEFINDER_COSCHEDULER_H
@@ -0,0 +1,200 @@
+//
+// Saves the radio settings and test parameters in flash, so that a test can start without anyone at the serial port.
+//
+
+#include "ConfigStore.h"
+
+#include <mbed.h>
+
+#include <cstring>
+
+#include "Checksum.h"
+
+namespace
+{
+	// Flash has to be programmed in whole pages, so the record gets copied into a padded buffer
+	const size_t flashBufferLen = 512;
+	MBED_ALIGN(8) uint8_t flashBuffer[flashBufferLen];
+
+	/**
+	 * Get the address of the record, which is the start of the last flash sector.
+	 * @return False if that sector overlaps the application image, e.g. because the firmware has grown to fill the flash
+	 */
+	bool getRecordAddress(FlashIAP & flash, uint32_t & address)
+	{
+		const uint32_t flashEnd = flash.get_flash_start() + flash.get_flash_size();
+		address = flashEnd - flash.get_sector_size(flashEnd - 1);
+
+#ifdef FLASHIAP_APP_ROM_END_ADDR
+		return address >= FLASHIAP_APP_ROM_END_ADDR;
+#else
+		return true;
+#endif
+	}
+}
+
+constexpr size_t ConfigStore::MAX_RADIOS;
+constexpr uint32_t ConfigStore::FLAG_LINK_ADAPTATION;
+constexpr uint32_t ConfigStore::FLAG_FEC;
+constexpr size_t ConfigStore::NUM_REGISTERS;
+constexpr size_t ConfigStore::NUM_EXT_REGISTERS;
+constexpr uint32_t ConfigStore::MAGIC;
+constexpr uint16_t ConfigStore::VERSION;
+
+ConfigStore::ConfigStore():
+record(),
+loaded(false)
+{
+	static_assert(sizeof(Record) <= flashBufferLen, "Config record doesn't fit in the flash buffer");
+	reset();
+}
+
+bool ConfigStore::load()
+{
+	loaded = false;
+
+	FlashIAP flash;
+	if(flash.init() != 0)
+	{
+		return false;
+	}
+	uint32_t address;
+	bool success = getRecordAddress(flash, address) && flash.read(flashBuffer, address, sizeof(Record)) == 0;
+	flash.deinit();
+
+	if(!success)
+	{
+		return false;
+	}
+
+	Record const & flashRecord = *reinterpret_cast<Record const *>(flashBuffer);
+	if(flashRecord.magic != MAGIC || flashRecord.version != VERSION || flashRecord.length != sizeof(Record)
+		|| flashRecord.crc != calculateCRC(flashRecord))
+	{
+		return false;
+	}
+
+	memcpy(&record, flashBuffer, sizeof(Record));
+	loaded = true;
+	return true;
+}
+
+bool ConfigStore::save()
+{
+	record.crc = calculateCRC(record);
+
+	FlashIAP flash;
+	if(flash.init() != 0)
+	{
+		return false;
+	}
+
+	uint32_t address;
+	if(!getRecordAddress(flash, address))
+	{
+		flash.deinit();
+		return false;
+	}
+
+	const uint32_t pageSize = flash.get_page_size();
+	const uint32_t programSize = ((sizeof(Record) + pageSize - 1) / pageSize) * pageSize;
+
+	memset(flashBuffer, flash.get_erase_value(), flashBufferLen);
+	memcpy(flashBuffer, &record, sizeof(Record));
+
+	bool success = flash.erase(address, flash.get_sector_size(address)) == 0
+		&& flash.program(flashBuffer, address, programSize) == 0;
+
+	flash.deinit();
+
+	loaded = success;
+	return success;
+}
+
+bool ConfigStore::clear()
+{
+	reset();
+	loaded = false;
+
+	FlashIAP flash;
+	if(flash.init() != 0)
+	{
+		return false;
+	}
+
+	uint32_t address;
+	bool success = getRecordAddress(flash, address) && flash.erase(address, flash.get_sector_size(address)) == 0;
+
+	flash.deinit();
+	return success;
+}
+
+bool ConfigStore::hasRadio(size_t radioIndex) const
+{
+	return radioIndex < MAX_RADIOS && record.radios[radioIndex].valid;
+}
+
+void ConfigStore::captureRadio(size_t radioIndex, CC1200 & radio, RadioSettings const & settings)
+{
+	if(radioIndex >= MAX_RADIOS)
+	{
+		return;
+	}
+
+	RadioImage & image = record.radios[radioIndex];
+	image.valid = true;
+
+	// memcpy so the padding bytes are copied too, they're included in the CRC
+	memcpy(&image.settings, &settings, sizeof(RadioSettings));
+
+	for(size_t index = 0; index < NUM_REGISTERS; ++index)
+	{
+		image.registers[index] = radio.readRegister(static_cast<CC1200::Register>(index));
+	}
+	for(size_t index = 0; index < NUM_EXT_REGISTERS; ++index)
+	{
+		image.extRegisters[index] = radio.readRegister(static_cast<CC1200::ExtRegister>(index));
+	}
+}
+
+bool ConfigStore::applyRadio(size_t radioIndex, CC1200 & radio, RadioSettings & settings) const
+{
+	if(!hasRadio(radioIndex))
+	{
+		return false;
+	}
+
+	RadioImage const & image = record.radios[radioIndex];
+
+	radio.writeRegisters(CC1200::Register::IOCFG3, image.registers, NUM_REGISTERS);
+	radio.writeRegisters(CC1200::ExtRegister::IF_MIX_CFG, image.extRegisters, NUM_EXT_REGISTERS);
+
+	// The driver keeps track of the FIFO and packet settings itself, so set those through the driver too
+	settings = image.settings;
+	const bool appendStatus = image.registers[static_cast<size_t>(CC1200::Register::PKT_CFG1)] & 0x1;
+
+	radio.configureFIFOMode();
+	radio.setPacketMode(settings.packetMode, appendStatus);
+	if(settings.packetMode == CC1200::PacketMode::FIXED_LENGTH)
+	{
+		radio.setPacketLength(settings.packetLength);
+	}
+	radio.setCRCEnabled(settings.crcEnabled);
+
+	return true;
+}
+
+void ConfigStore::reset()
+{
+	// memset rather than assignment so the padding is zeroed too, since it goes into the CRC
+	memset(static_cast<void *>(&record), 0, sizeof(Record));
+	record.magic = MAGIC;
+	record.version = VERSION;
+	record.length = sizeof(Record);
+	record.testSelection = -1;
+}
+
+uint16_t ConfigStore::calculateCRC(Record const & record)
+{
+	return crc16CCITT(reinterpret_cast<uint8_t const *>(&record), offsetof(Record, crc));
+}
@@ -0,0 +1,131 @@
+//
+// Saves the radio settings and test parameters in flash, so that a test can start without anyone at the serial port.
+//
+
+#ifndef LIGHTSPEEDRANGEFINDER_CONFIGSTORE_H
+#define LIGHTSPEEDRANGEFINDER_CONFIGSTORE_H
+
+#include <CC1200.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "RadioSettingsMenu.h"
+
+/**
+ * Configuration record kept in the last sector of the MCU's flash.
+ *
+ * For each radio, the record holds the RadioSettings plus an image of the radio's configuration registers
+ * taken right after the settings were applied.  At boot the image is burst written back to the radio,
+ * which takes a couple of SPI transactions instead of going through the menus.
+ * The record has a magic number, version and CRC, so a blank, old or corrupted record is ignored.
+ * If the firmware grows into the last sector, the store refuses to touch it rather than erase part of the program.
+ */
+class ConfigStore
+{
+public:
+
+	// Enough for TestJitter, which uses both radios
+	static constexpr size_t MAX_RADIOS = 2;
+
+	// Test flags shared between the tests
+	static constexpr uint32_t FLAG_LINK_ADAPTATION = 1 << 0;
+	static constexpr uint32_t FLAG_FEC = 1 << 1;
+
+	// Config registers 0x00-0x2E and extended config registers 0x2F00-0x2F39
+	static constexpr size_t NUM_REGISTERS = 0x2F;
+	static constexpr size_t NUM_EXT_REGISTERS = 0x3A;
+
+	ConfigStore();
+
+	/**
+	 * Read the record from flash.
+	 * @return false if there is no valid record
+	 */
+	bool load();
+
+	/**
+	 * Write the record to flash.  Erases the sector, so it takes a while.
+	 * @return false if the flash operation failed or the sector overlaps the firmware
+	 */
+	bool save();
+
+	/**
+	 * Erase the record from flash, so the next boot goes through the menus again.
+	 * @return false if the flash operation failed or the sector overlaps the firmware
+	 */
+	bool clear();
+
+	/**
+	 * @return Whether the record matches what's in flash, i.e. it was loaded or saved (as opposed to filled in since boot)
+	 */
+	bool isLoaded() const { return loaded; }
+
+	/**
+	 * @return Whether the record has settings for the given radio
+	 */
+	bool hasRadio(size_t radioIndex) const;
+
+	/**
+	 * Save the current register values and settings of a radio into the record.
+	 * Call right after the config and board revision are applied, before any test specific changes.
+	 */
+	void captureRadio(size_t radioIndex, CC1200 & radio, RadioSettings const & settings);
+
+	/**
+	 * Write the saved register image to a radio, and bring the driver's state back in line with it.
+	 * @param settings Set to the saved settings
+	 * @return false if there are no saved settings for this radio
+	 */
+	bool applyRadio(size_t radioIndex, CC1200 & radio, RadioSettings & settings) const;
+
+	uint32_t getTestFlags() const { return record.testFlags; }
+	void setTestFlags(uint32_t testFlags) { record.testFlags = testFlags; }
+
+	/**
+	 * Test specific selection, e.g. the menu option to run at boot.  -1 if none.
+	 */
+	int32_t getTestSelection() const { return record.testSelection; }
+	void setTestSelection(int32_t testSelection) { record.testSelection = testSelection; }
+
+private:
+
+	static constexpr uint32_t MAGIC = 0x4C535243; // "LSRC"
+
+	// Change whenever the record layout changes
+	static constexpr uint16_t VERSION = 1;
+
+	struct RadioImage
+	{
+		bool valid;
+		RadioSettings settings;
+		uint8_t registers[NUM_REGISTERS];
+		uint8_t extRegisters[NUM_EXT_REGISTERS];
+	};
+
+	struct Record
+	{
+		uint32_t magic;
+		uint16_t version;
+		uint16_t length;
+
+		uint32_t testFlags;
+		int32_t testSelection;
+		RadioImage radios[MAX_RADIOS];
+
+		// CRC of everything before it
+		uint16_t crc;
+	};
+
+	Record record;
+	bool loaded;
+
+	/**
+	 * Reset the record to empty
+	 */
+	void reset();
+
+	static uint16_t calculateCRC(Record const & record);
+};
+
+#endif //LIGHTSPEEDRANGEFINDER_CONFIGSTORE_H
@@ -0,0 +1,186 @@
+//
+// Benchmark comparing the cost of switching between coroutine tasks (CoScheduler) and between RTOS threads,
+// followed by a demo of several activities interleaving on one core.  Needs C++20, see the README.
+//
+
+#include <mbed.h>
+
+#include <cinttypes>
+
+#include "CoScheduler.h"
+#include "CycleCounter.h"
+
+// Send printf output over the USB serial port at the same baudrate as the other tests
+FileHandle *mbed::mbed_override_console(int)
+{
+	static BufferedSerial serial(USBTX, USBRX, 115200);
+	return &serial;
+}
+
+const size_t numRounds = 10000;
+
+// Stack size for each benchmark thread.  Mbed's default is 4kiB, this is about the smallest that's safe with printf.
+const size_t threadStackSize = 1024;
+MBED_ALIGN(8) unsigned char threadStacks[2][threadStackSize];
+
+/**
+ * Print the result of one benchmark.
+ */
+void printResult(char const * name, size_t numSwitches, CycleCounter::cycles_t cycles)
+{
+	printf("%-36s %8" PRIu32 " %s total, %.01f per switch\n", name, static_cast<uint32_t>(cycles), CycleCounter::getUnitName(),
+		static_cast<float>(cycles) / numSwitches);
+}
+
+CoTask yieldTask(size_t count)
+{
+	for(size_t round = 0; round < count; ++round)
+	{
+		co_await yield();
+	}
+}
+
+EventFlag pingFlag;
+EventFlag pongFlag;
+
+CoTask pingTask(size_t count)
+{
+	for(size_t round = 0; round < count; ++round)
+	{
+		pongFlag.set();
+		co_await pingFlag.wait();
+	}
+}
+
+CoTask pongTask(size_t count)
+{
+	for(size_t round = 0; round < count; ++round)
+	{
+		co_await pongFlag.wait();
+		pingFlag.set();
+	}
+}
+
+void benchmarkCoroutines()
+{
+	{
+		CoScheduler scheduler;
+		scheduler.spawn(yieldTask(numRounds));
+		scheduler.spawn(yieldTask(numRounds));
+
+		CycleCounter::cycles_t start = CycleCounter::now();
+		scheduler.run();
+		printResult("Coroutine yield", scheduler.getNumResumes(), CycleCounter::now() - start);
+	}
+
+	{
+		CoScheduler scheduler;
+		scheduler.spawn(pingTask(numRounds));
+		scheduler.spawn(pongTask(numRounds));
+
+		CycleCounter::cycles_t start = CycleCounter::now();
+		scheduler.run();
+		printResult("Coroutine event flag ping-pong", scheduler.getNumResumes(), CycleCounter::now() - start);
+	}
+}
+
+const uint32_t pingThreadFlag = 1 << 0;
+const uint32_t pongThreadFlag = 1 << 1;
+EventFlags threadFlags;
+
+void pingThread()
+{
+	for(size_t round = 0; round < numRounds; ++round)
+	{
+		threadFlags.set(pongThreadFlag);
+		threadFlags.wait_any(pingThreadFlag);
+	}
+}
+
+void pongThread()
+{
+	for(size_t round = 0; round < numRounds; ++round)
+	{
+		threadFlags.wait_any(pongThreadFlag);
+		threadFlags.set(pingThreadFlag);
+	}
+}
+
+void benchmarkThreads()
+{
+	// Higher priority than main, so the threads only switch between each other
+	Thread ping(osPriorityHigh, threadStackSize, threadStacks[0], "ping");
+	Thread pong(osPriorityHigh, threadStackSize, threadStacks[1], "pong");
+
+	CycleCounter::cycles_t start = CycleCounter::now();
+	pong.start(pongThread);
+	ping.start(pingThread);
+	ping.join();
+	pong.join();
+	printResult("RTOS thread event flags ping-pong", 2 * numRounds, CycleCounter::now() - start);
+}
+
+// Fake radio GPIO interrupt for the demo
+EventFlag syncEvent;
+Ticker syncTicker;
+
+CoTask rangingDemoTask()
+{
+	for(size_t exchange = 0; exchange < 10; ++exchange)
+	{
+		co_await sleepFor(20ms);
+		printf("[%6" PRIi64 " us] ranging: exchange %zu\n", static_cast<int64_t>(CoScheduler::now().count()), exchange);
+	}
+}
+
+CoTask telemetryDemoTask()
+{
+	for(size_t frame = 0; frame < 4; ++frame)
+	{
+		co_await sleepFor(50ms);
+		printf("[%6" PRIi64 " us] telemetry: frame %zu\n", static_cast<int64_t>(CoScheduler::now().count()), frame);
+	}
+}
+
+CoTask streamDemoTask()
+{
+	for(size_t chunk = 0; chunk < 5; ++chunk)
+	{
+		bool gotSync = co_await syncEvent.wait(100ms);
+		printf("[%6" PRIi64 " us] stream: chunk %zu %s\n", static_cast<int64_t>(CoScheduler::now().count()), chunk,
+			gotSync ? "synced" : "timed out");
+	}
+}
+
+void runInterleaveDemo()
+{
+	printf("\nInterleave demo:\n");
+
+	syncTicker.attach([]() { syncEvent.set(); }, 35ms);
+
+	CoScheduler scheduler;
+	scheduler.spawn(rangingDemoTask());
+	scheduler.spawn(telemetryDemoTask());
+	scheduler.spawn(streamDemoTask());
+	scheduler.run();
+
+	syncTicker.detach();
+}
+
+int main()
+{
+	printf("\nCoroutine scheduler benchmark, %zu rounds\n", numRounds);
+
+	CycleCounter::begin();
+
+	benchmarkCoroutines();
+	benchmarkThreads();
+
+	printf("RAM per task: coroutine frame %zu bytes (largest so far), thread stack %zu bytes plus its control block\n",
+		CoTask::getLargestFrameSize(), threadStackSize);
+
+	runInterleaveDemo();
+
+	printf("done.\n");
+	return 0;
+}
@@ -0,0 +1,73 @@
+//
+// Cycle counter for benchmarks, so that the same benchmark code can run on the MCU and on a PC.
+//
+
+#ifndef LIGHTSPEEDRANGEFINDER_CYCLECOUNTER_H
+#define LIGHTSPEEDRANGEFINDER_CYCLECOUNTER_H
+
+#include <cstdint>
+
+#if defined(__MBED__)
+#include <mbed.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+/**
+ * Reads the CPU's cycle counter.
+ *
+ * On the MCU this uses the Cortex-M DWT cycle counter, which is 32 bits and so wraps after
+ * a few tens of seconds.  On x86 PCs it uses the TSC, which counts at a constant reference rate.
+ * On anything else it falls back to counting nanoseconds.
+ */
+class CycleCounter
+{
+public:
+
+#if defined(__MBED__)
+	typedef uint32_t cycles_t;
+#else
+	typedef uint64_t cycles_t;
+#endif
+
+	/**
+	 * Enable the counter.  Must be called before now() is used.
+	 */
+	static void begin()
+	{
+#if defined(__MBED__)
+		CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+		DWT->CYCCNT = 0;
+		DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+	}
+
+	static cycles_t now()
+	{
+#if defined(__MBED__)
+		return DWT->CYCCNT;
+#elif defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	/**
+	 * @return Name of what the counter actually counts, for printing with results.
+	 */
+	static char const * getUnitName()
+	{
+#if defined(__MBED__)
+		return "CPU cycles";
+#elif defined(__x86_64__) || defined(__i386__)
+		return "TSC ticks";
+#else
+		return "ns";
+#endif
+	}
+};
+
+#endif //LIGHTSPEEDRANGEFINDER_CYCLECOUNTER_H
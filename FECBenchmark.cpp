@@ -0,0 +1,138 @@
+//
+// Benchmark of the stream FEC codec throughput.  Builds both for the MCU (with Mbed OS) and as a
+// command line program on a PC, e.g.:
+//   g++ -O2 -std=c++14 FECBenchmark.cpp StreamFEC.cpp -o FECBenchmark
+//
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "CycleCounter.h"
+#include "StreamFEC.h"
+
+#if defined(__MBED__)
+// Send printf output over the USB serial port at the same baudrate as the other tests
+FileHandle *mbed::mbed_override_console(int)
+{
+	static BufferedSerial serial(USBTX, USBRX, 115200);
+	return &serial;
+}
+#endif
+
+const size_t numBlocks = 500;
+
+// Fastest stream we need to keep up with: 500 ksps, one bit per symbol
+const float requiredBytesPerSecond = 500000.0f / 8;
+
+uint8_t payloads[numBlocks][StreamFEC::PAYLOAD_LEN];
+uint8_t blocks[numBlocks][StreamFEC::BLOCK_LEN];
+uint8_t decodedPayload[StreamFEC::PAYLOAD_LEN];
+
+/**
+ * Print the result of one benchmark.
+ * @param blockBytes Number of block bytes processed
+ */
+void printResult(char const * name, size_t blockBytes, CycleCounter::cycles_t cycles)
+{
+	printf("%-32s %10" PRIu64 " %s, %.04f bytes/cycle, %.01f cycles/byte",
+		name, static_cast<uint64_t>(cycles), CycleCounter::getUnitName(),
+		static_cast<float>(blockBytes) / cycles, static_cast<float>(cycles) / blockBytes);
+
+#if defined(__MBED__)
+	// On the MCU we know the clock rate, so we can tell whether the codec keeps up with the radio
+	float bytesPerSecond = (static_cast<float>(blockBytes) / cycles) * SystemCoreClock;
+	printf(", %.01f kB/s (%.01fx the 500ksps stream rate)", bytesPerSecond / 1000, bytesPerSecond / requiredBytesPerSecond);
+#endif
+
+	printf("\n");
+}
+
+/**
+ * Corrupt bytes in every block.
+ * @param errorsPerCodeword Number of bytes to corrupt in each codeword
+ */
+void corruptBlocks(size_t errorsPerCodeword)
+{
+	for(size_t blockIndex = 0; blockIndex < numBlocks; ++blockIndex)
+	{
+		// corrupt a burst, which the interleaver spreads across the codewords
+		size_t burstLen = errorsPerCodeword * StreamFEC::INTERLEAVE_DEPTH;
+		size_t burstStart = rand() % (StreamFEC::BLOCK_LEN - burstLen + 1);
+		for(size_t index = burstStart; index < burstStart + burstLen; ++index)
+		{
+			blocks[blockIndex][index] ^= static_cast<uint8_t>((rand() % 255) + 1);
+		}
+	}
+}
+
+/**
+ * Decode every block and time it.
+ */
+void benchmarkDecode(char const * name)
+{
+	StreamFEC fec;
+
+	CycleCounter::cycles_t start = CycleCounter::now();
+	for(size_t blockIndex = 0; blockIndex < numBlocks; ++blockIndex)
+	{
+		fec.decodeBlock(blocks[blockIndex], decodedPayload);
+	}
+	CycleCounter::cycles_t cycles = CycleCounter::now() - start;
+
+	// decode again outside of the timed loop to check the payloads, since the decoder can't detect a miscorrection
+	StreamFEC checkFec;
+	size_t miscorrectedBlocks = 0;
+	for(size_t blockIndex = 0; blockIndex < numBlocks; ++blockIndex)
+	{
+		if(checkFec.decodeBlock(blocks[blockIndex], decodedPayload) &&
+			memcmp(decodedPayload, payloads[blockIndex], StreamFEC::PAYLOAD_LEN) != 0)
+		{
+			++miscorrectedBlocks;
+		}
+	}
+
+	printResult(name, numBlocks * StreamFEC::BLOCK_LEN, cycles);
+	printf("    %zu bytes corrected, %zu/%zu blocks failed, %zu/%zu blocks miscorrected\n",
+		fec.getCorrectedBytes(), fec.getFailedBlocks(), fec.getNumBlocks(), miscorrectedBlocks, numBlocks);
+}
+
+int main()
+{
+	printf("\nStream FEC benchmark: RS(%zu, %zu) x%zu interleaved, %zu blocks of %zu bytes\n",
+		ReedSolomon::CODEWORD_LEN, ReedSolomon::DATA_LEN, StreamFEC::INTERLEAVE_DEPTH, numBlocks, StreamFEC::BLOCK_LEN);
+
+	CycleCounter::begin();
+
+	for(size_t blockIndex = 0; blockIndex < numBlocks; ++blockIndex)
+	{
+		for(size_t index = 0; index < StreamFEC::PAYLOAD_LEN; ++index)
+		{
+			payloads[blockIndex][index] = static_cast<uint8_t>(rand());
+		}
+	}
+
+	CycleCounter::cycles_t start = CycleCounter::now();
+	for(size_t blockIndex = 0; blockIndex < numBlocks; ++blockIndex)
+	{
+		StreamFEC::encodeBlock(payloads[blockIndex], blocks[blockIndex]);
+	}
+	printResult("Encode", numBlocks * StreamFEC::BLOCK_LEN, CycleCounter::now() - start);
+
+	benchmarkDecode("Decode, no errors");
+
+	corruptBlocks(1);
+	benchmarkDecode("Decode, 1 error/codeword");
+
+	// re-encode to get rid of the previous errors, then go to the max correctable
+	for(size_t blockIndex = 0; blockIndex < numBlocks; ++blockIndex)
+	{
+		StreamFEC::encodeBlock(payloads[blockIndex], blocks[blockIndex]);
+	}
+	corruptBlocks(ReedSolomon::MAX_CORRECTABLE);
+	benchmarkDecode("Decode, max errors/codeword");
+
+	printf("done.\n");
+	return 0;
+}
@@ -0,0 +1,264 @@
+//
+// Closed-loop link adaptation for the streaming tests: picks the fastest radio profile
+// that the link can currently support, and agrees on it with the other side.
+//
+
+#include "LinkAdaptation.h"
+
+#include <mbed.h>
+
+#include "LinkTiming.h"
+
+constexpr size_t LinkAdapter::NUM_PROFILES;
+constexpr size_t LinkAdapter::NUM_IF_VARIANTS;
+
+const int LinkAdapter::profileConfigs[NUM_PROFILES][NUM_IF_VARIANTS] = {{1, 2, 3}, {4, 5, 6}, {7, 8, 9}};
+
+// typical 2-GFSK/2-FSK figures from the CC1200 datasheet.  Config 9 has twice the channel filter bandwidth, so 3dB more noise.
+const float LinkAdapter::profileSensitivities[NUM_PROFILES][NUM_IF_VARIANTS] = {{-109, -109, -109}, {-104, -104, -104}, {-97, -97, -94}};
+
+LinkAdapter::LinkAdapter(float rssiMargin, float hysteresis, float maxLQI, size_t stepUpCount, size_t maxMissedExchanges):
+rssiMargin(rssiMargin),
+hysteresis(hysteresis),
+maxLQI(maxLQI),
+stepUpCount(stepUpCount),
+maxMissedExchanges(maxMissedExchanges)
+{
+}
+
+int LinkAdapter::getNextConfig(bool streamSuccessful, float rssi, float lqi)
+{
+	const size_t variantIndex = variantIndices[profileIndex];
+	const float sensitivity = profileSensitivities[profileIndex][variantIndex];
+
+	bool marginal = !streamSuccessful || rssi < sensitivity + rssiMargin || lqi > maxLQI;
+	if(marginal)
+	{
+		goodStreamCount = 0;
+
+		// plenty of signal, so try another IF variant of this rate before slowing down
+		if(rssi >= sensitivity + rssiMargin + hysteresis && variantSwitches + 1 < NUM_IF_VARIANTS)
+		{
+			++variantSwitches;
+			return profileConfigs[profileIndex][(variantIndex + 1) % NUM_IF_VARIANTS];
+		}
+
+		variantSwitches = 0;
+		return getRungConfig(profileIndex > 0 ? profileIndex - 1 : 0);
+	}
+	variantSwitches = 0;
+
+	if(profileIndex + 1 < NUM_PROFILES
+		&& rssi >= profileSensitivities[profileIndex + 1][variantIndices[profileIndex + 1]] + rssiMargin + hysteresis)
+	{
+		++goodStreamCount;
+		if(goodStreamCount >= stepUpCount)
+		{
+			goodStreamCount = 0;
+			return getRungConfig(profileIndex + 1);
+		}
+	}
+	else
+	{
+		goodStreamCount = 0;
+	}
+
+	return getConfig();
+}
+
+bool LinkAdapter::setConfig(int config)
+{
+	for(size_t index = 0; index < NUM_PROFILES; ++index)
+	{
+		for(size_t variant = 0; variant < NUM_IF_VARIANTS; ++variant)
+		{
+			if(profileConfigs[index][variant] == config)
+			{
+				profileIndex = index;
+				variantIndices[index] = variant;
+				return true;
+			}
+		}
+	}
+
+	profileIndex = 0;
+	variantIndices[0] = 0;
+	return false;
+}
+
+bool LinkAdapter::recordControlExchange(bool successful)
+{
+	if(successful)
+	{
+		missedExchangeCount = 0;
+		return false;
+	}
+
+	++missedExchangeCount;
+	if(missedExchangeCount >= maxMissedExchanges)
+	{
+		// The other side has probably lost us.  It will fall back too after the same number of misses.
+		missedExchangeCount = 0;
+		goodStreamCount = 0;
+		variantSwitches = 0;
+		profileIndex = 0;
+		variantIndices[0] = 0;
+		return true;
+	}
+	return false;
+}
+
+namespace
+{
+	const char controlFrameMagic[] = {'L', 'A'};
+
+	// magic, type, sequence, config
+	const size_t controlFrameLen = sizeof(controlFrameMagic) + 3;
+
+	/**
+	 * Get the time allowed for the other side to respond to a control frame.
+	 */
+	std::chrono::microseconds getControlResponseTimeout(RadioSettings settings)
+	{
+		settings.packetMode = CC1200::PacketMode::VARIABLE_LENGTH;
+		settings.crcEnabled = true;
+		LinkTiming timing(settings);
+
+		// The responder has to go through IDLE to load the response, so it calibrates on the way to TX
+		return LinkTiming::getTimeout(timing.getPacketAirtime(controlFrameLen) + LinkTiming::IDLE_TO_ACTIVE_TIME + timing.getPacketAirtime(controlFrameLen));
+	}
+}
+
+constexpr size_t LinkControlChannel::MAX_REQUEST_ATTEMPTS;
+
+LinkControlChannel::LinkControlChannel(CC1200 & radio):
+radio(radio)
+{
+}
+
+void LinkControlChannel::enterControlMode()
+{
+	radio.setPacketMode(CC1200::PacketMode::VARIABLE_LENGTH);
+	radio.setCRCEnabled(true);
+}
+
+bool LinkControlChannel::waitForTXDone(std::chrono::microseconds timeout)
+{
+	Timer txTimer;
+	txTimer.start();
+	while(txTimer.elapsed_time() < timeout)
+	{
+		radio.updateState();
+		if(radio.getTXFIFOLen() == 0 && radio.getState() != CC1200::State::TX)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+int LinkControlChannel::readFrame(FrameType type, uint8_t & sequence)
+{
+	char frame[controlFrameLen];
+	if(radio.receivePacket(frame, sizeof(frame)) != controlFrameLen)
+	{
+		return -1;
+	}
+
+	if(frame[0] != controlFrameMagic[0] || frame[1] != controlFrameMagic[1] || static_cast<uint8_t>(frame[2]) != static_cast<uint8_t>(type))
+	{
+		return -1;
+	}
+
+	sequence = static_cast<uint8_t>(frame[3]);
+	return static_cast<uint8_t>(frame[4]);
+}
+
+bool LinkControlChannel::requestConfig(int config, RadioSettings const & settings)
+{
+	enterControlMode();
+
+	// go straight to RX after sending the request so we don't miss the ack
+	radio.setOnTransmitState(CC1200::State::RX);
+
+	const uint8_t sequence = nextSequence++;
+	const char request[controlFrameLen] = {controlFrameMagic[0], controlFrameMagic[1], static_cast<char>(FrameType::REQUEST),
+		static_cast<char>(sequence), static_cast<char>(config)};
+
+	const std::chrono::microseconds ackTimeout = getControlResponseTimeout(settings);
+
+	bool acknowledged = false;
+	for(size_t attempt = 0; attempt < MAX_REQUEST_ATTEMPTS && !acknowledged; ++attempt)
+	{
+		radio.enqueuePacket(request, sizeof(request));
+		radio.startTX();
+
+		Timer ackTimer;
+		ackTimer.start();
+		while(ackTimer.elapsed_time() < ackTimeout)
+		{
+			if(radio.hasReceivedPacket())
+			{
+				uint8_t ackSequence;
+				if(readFrame(FrameType::ACK, ackSequence) == config && ackSequence == sequence)
+				{
+					acknowledged = true;
+				}
+				break;
+			}
+		}
+
+		radio.idle();
+		radio.sendCommand(CC1200::Command::FLUSH_RX);
+		radio.sendCommand(CC1200::Command::FLUSH_TX);
+	}
+
+	radio.setOnTransmitState(CC1200::State::IDLE);
+	return acknowledged;
+}
+
+int LinkControlChannel::waitForRequest(RadioSettings const & settings, std::chrono::microseconds timeout)
+{
+	enterControlMode();
+
+	// stop after a good packet so that it can be answered, but keep listening after a bad one
+	radio.setOnReceiveState(CC1200::State::IDLE, CC1200::State::RX);
+	radio.setOnTransmitState(CC1200::State::IDLE);
+	radio.startRX();
+
+	int requestedConfig = -1;
+
+	// Keep listening for the whole time, so that a repeated request can be acked again if our ack got lost.
+	Timer listenTimer;
+	listenTimer.start();
+	while(listenTimer.elapsed_time() < timeout)
+	{
+		if(!radio.hasReceivedPacket())
+		{
+			continue;
+		}
+
+		uint8_t sequence;
+		int frameConfig = readFrame(FrameType::REQUEST, sequence);
+		if(frameConfig >= 0)
+		{
+			// Answer right away, the other side is waiting for it.
+			requestedConfig = frameConfig;
+			const char ack[controlFrameLen] = {controlFrameMagic[0], controlFrameMagic[1], static_cast<char>(FrameType::ACK),
+				static_cast<char>(sequence), static_cast<char>(requestedConfig)};
+			radio.enqueuePacket(ack, sizeof(ack));
+			radio.startTX();
+			waitForTXDone(getControlResponseTimeout(settings));
+		}
+
+		// FIFO can only be flushed from IDLE
+		radio.idle();
+		radio.sendCommand(CC1200::Command::FLUSH_RX);
+		radio.startRX();
+	}
+
+	radio.idle();
+	radio.sendCommand(CC1200::Command::FLUSH_RX);
+	radio.sendCommand(CC1200::Command::FLUSH_TX);
+	return requestedConfig;
+}
@@ -0,0 +1,163 @@
+//
+// Closed-loop link adaptation for the streaming tests: picks the fastest radio profile
+// that the link can currently support, and agrees on it with the other side.
+//
+
+#ifndef LIGHTSPEEDRANGEFINDER_LINKADAPTATION_H
+#define LIGHTSPEEDRANGEFINDER_LINKADAPTATION_H
+
+#include <CC1200.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "RadioSettingsMenu.h"
+
+/**
+ * Decides which radio profile to use based on the RSSI and LQI seen on the last stream.
+ *
+ * Profiles form a ladder of symbol rates from most robust to fastest.  The adapter steps down a rung as soon as the link
+ * looks marginal, but only steps up after the link has had enough margin for the next rung for several streams
+ * in a row, so it doesn't oscillate between two profiles.
+ *
+ * Each rung has the default, Max-IF and Zero-IF variants of its symbol rate.  If a stream fails or has poor LQI while
+ * the RSSI is well clear of the sensitivity, the signal level isn't the problem, so the adapter tries the other IF
+ * variants of the same rate (which respond differently to images, DC offset and frequency error) before stepping down.
+ * It only leaves a variant when it turns marginal, and remembers the last variant used on each rung.
+ */
+class LinkAdapter
+{
+public:
+
+	static constexpr size_t NUM_PROFILES = 3;
+	static constexpr size_t NUM_IF_VARIANTS = 3;
+
+	/// Configs (from the radio settings menu) on the ladder, from most robust to fastest.
+	/// Each rung lists the default, Max-IF and Zero-IF variants.
+	static const int profileConfigs[NUM_PROFILES][NUM_IF_VARIANTS];
+
+	/// Approximate receive sensitivity of each config, in dBm
+	static const float profileSensitivities[NUM_PROFILES][NUM_IF_VARIANTS];
+
+	/**
+	 * @param rssiMargin Margin above sensitivity (in dB) that the RSSI must have to stay on a profile
+	 * @param hysteresis Additional margin (in dB) needed before stepping up to a faster profile, or trying another IF variant
+	 * @param maxLQI LQI above which the link is treated as marginal (lower LQI is better on the CC1200)
+	 * @param stepUpCount Number of consecutive good streams needed before stepping up
+	 * @param maxMissedExchanges Number of consecutive failed control exchanges before falling back to the most robust profile
+	 */
+	LinkAdapter(float rssiMargin = 6, float hysteresis = 4, float maxLQI = 60, size_t stepUpCount = 3, size_t maxMissedExchanges = 3);
+
+	/**
+	 * Get the config that should be used next, based on the result of the last stream.
+	 * Does not change the current config, call setConfig() once the other side has agreed.
+	 * @param streamSuccessful Whether the stream was received all the way to the end without errors
+	 * @param rssi Average RSSI during the stream
+	 * @param lqi Average LQI during the stream
+	 */
+	int getNextConfig(bool streamSuccessful, float rssi, float lqi);
+
+	/**
+	 * Set the current config.
+	 * @return false if the config isn't on the ladder, in which case the most robust profile is used instead.
+	 */
+	bool setConfig(int config);
+
+	/**
+	 * Record the result of a control exchange with the other side.
+	 * @return true if too many exchanges have failed in a row and the adapter has fallen back to the most robust profile.
+	 */
+	bool recordControlExchange(bool successful);
+
+	int getConfig() const
+	{
+		return profileConfigs[profileIndex][variantIndices[profileIndex]];
+	}
+
+private:
+
+	/**
+	 * @return Config of a rung, using the IF variant last used on it
+	 */
+	int getRungConfig(size_t rung) const
+	{
+		return profileConfigs[rung][variantIndices[rung]];
+	}
+
+	float rssiMargin;
+	float hysteresis;
+	float maxLQI;
+	size_t stepUpCount;
+	size_t maxMissedExchanges;
+
+	size_t profileIndex = 0;
+	size_t variantIndices[NUM_PROFILES] = {};
+	size_t variantSwitches = 0; // IF variants tried on this rung since the last good stream
+	size_t goodStreamCount = 0;
+	size_t missedExchangeCount = 0;
+};
+
+/**
+ * Small in-band control channel used by the two sides of a stream to agree on profile changes.
+ *
+ * Control frames are sent as variable length packets with CRC on the current profile.  The receiving
+ * side of the stream requests a config, and the transmitting side acknowledges it.  Both sides only
+ * switch once the request has been acknowledged.
+ */
+class LinkControlChannel
+{
+public:
+
+	/// Number of times a request is sent before giving up
+	static constexpr size_t MAX_REQUEST_ATTEMPTS = 3;
+
+	explicit LinkControlChannel(CC1200 & radio);
+
+	/**
+	 * Ask the other side to switch to a config, and wait for it to acknowledge.
+	 * The radio must be in IDLE.  It is left in IDLE in variable length mode.
+	 * @param settings Settings currently applied to the radio
+	 * @return true if the request was acknowledged.
+	 */
+	bool requestConfig(int config, RadioSettings const & settings);
+
+	/**
+	 * Listen for config requests from the other side and acknowledge them.
+	 * Listens for the whole timeout, so that repeated requests get acknowledged too.
+	 * The radio must be in IDLE.  It is left in IDLE in variable length mode.
+	 * @param settings Settings currently applied to the radio
+	 * @param timeout How long to listen for
+	 * @return The last requested config, or -1 if no request was received.
+	 */
+	int waitForRequest(RadioSettings const & settings, std::chrono::microseconds timeout);
+
+private:
+
+	enum class FrameType : uint8_t
+	{
+		REQUEST = 1,
+		ACK = 2
+	};
+
+	/**
+	 * Switch the radio to the packet format used for control frames.
+	 */
+	void enterControlMode();
+
+	/**
+	 * Wait for the radio to finish transmitting.
+	 */
+	bool waitForTXDone(std::chrono::microseconds timeout);
+
+	/**
+	 * Read a received frame and check that it's a control frame of the given type.
+	 * @return The config in the frame, or -1 if it's invalid
+	 */
+	int readFrame(FrameType type, uint8_t & sequence);
+
+	CC1200 & radio;
+	uint8_t nextSequence = 0;
+};
+
+#endif //LIGHTSPEEDRANGEFINDER_LINKADAPTATION_H
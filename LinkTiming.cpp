@@ -0,0 +1,94 @@
+//
+// Model of how long things take on the air for a given radio configuration.
+//
+
+#include "LinkTiming.h"
+
+#include <cmath>
+
+namespace
+{
+	// Preamble length in bits for each value of PREAMBLE_CFG1.NUM_PREAMBLE
+	const size_t preambleBitsTable[] = {0, 4, 8, 12, 16, 24, 32, 40, 48, 56, 64, 96, 192, 240};
+
+	// Sync word length in bits for each value of SYNC_CFG0.SYNC_MODE
+	const size_t syncBitsTable[] = {0, 11, 16, 18, 24, 32, 16, 16};
+
+	const size_t crcBits = 16;
+	const size_t lengthFieldBits = 8;
+}
+
+constexpr std::chrono::microseconds LinkTiming::IDLE_TO_ACTIVE_TIME;
+constexpr std::chrono::microseconds LinkTiming::TURNAROUND_TIME;
+constexpr std::chrono::microseconds LinkTiming::TIMEOUT_SLACK;
+
+LinkTiming::LinkTiming(RadioSettings const & settings):
+settings(settings)
+{
+	float bitsPerSymbol = 1;
+	if(settings.modFormat == CC1200::ModFormat::FSK_4 || settings.modFormat == CC1200::ModFormat::GFSK_4)
+	{
+		bitsPerSymbol = 2;
+	}
+
+	// fall back to the slowest rate in the menu if the settings are invalid, so timeouts err on the long side
+	float symbolRate = settings.symbolRate > 0 ? settings.symbolRate : 38400;
+
+	bitTime = std::chrono::nanoseconds(static_cast<int64_t>(std::ceil(1e9f / (symbolRate * bitsPerSymbol))));
+}
+
+size_t LinkTiming::getPreambleBits() const
+{
+	if(settings.preambleLengthCfg >= sizeof(preambleBitsTable) / sizeof(size_t))
+	{
+		return preambleBitsTable[sizeof(preambleBitsTable) / sizeof(size_t) - 1];
+	}
+	return preambleBitsTable[settings.preambleLengthCfg];
+}
+
+size_t LinkTiming::getSyncBits() const
+{
+	return syncBitsTable[static_cast<uint8_t>(settings.syncMode) & 0b111];
+}
+
+std::chrono::nanoseconds LinkTiming::getOverheadTime() const
+{
+	return bitTime * (getPreambleBits() + getSyncBits());
+}
+
+std::chrono::nanoseconds LinkTiming::getDataTime(size_t numBytes) const
+{
+	return bitTime * (numBytes * 8);
+}
+
+std::chrono::nanoseconds LinkTiming::getPacketAirtime(size_t payloadLen) const
+{
+	size_t framingBits = 0;
+	if(settings.packetMode == CC1200::PacketMode::VARIABLE_LENGTH)
+	{
+		framingBits += lengthFieldBits;
+	}
+	if(settings.crcEnabled && settings.packetMode != CC1200::PacketMode::INFINITE_LENGTH)
+	{
+		framingBits += crcBits;
+	}
+
+	return getOverheadTime() + getDataTime(payloadLen) + bitTime * framingBits;
+}
+
+std::chrono::nanoseconds LinkTiming::getExchangeTime(size_t requestLen, LinkTiming const & responder, size_t responseLen) const
+{
+	return getPacketAirtime(requestLen) + TURNAROUND_TIME + responder.getPacketAirtime(responseLen);
+}
+
+std::chrono::microseconds LinkTiming::getTimeout(std::chrono::nanoseconds expectedTime)
+{
+	// round up to the next microsecond (std::chrono::ceil is C++17)
+	const std::chrono::nanoseconds doubledTime = expectedTime * 2;
+	std::chrono::microseconds timeout = std::chrono::duration_cast<std::chrono::microseconds>(doubledTime);
+	if(timeout < doubledTime)
+	{
+		timeout += std::chrono::microseconds(1);
+	}
+	return timeout + TIMEOUT_SLACK;
+}
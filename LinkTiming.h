@@ -0,0 +1,88 @@
+//
+// Model of how long things take on the air for a given radio configuration.
+//
+
+#ifndef LIGHTSPEEDRANGEFINDER_LINKTIMING_H
+#define LIGHTSPEEDRANGEFINDER_LINKTIMING_H
+
+#include <chrono>
+#include <cstddef>
+
+#include "RadioSettingsMenu.h"
+
+/**
+ * Computes packet airtime, preamble & sync overhead, and radio turnaround times from
+ * the active radio settings.  Used to derive tight timeouts and to schedule transmissions
+ * back to back instead of using hardcoded delays.
+ */
+class LinkTiming
+{
+public:
+
+	/// Time for the radio to go from IDLE to TX or RX, including FS calibration (approximate)
+	static constexpr std::chrono::microseconds IDLE_TO_ACTIVE_TIME{450};
+
+	/// Time for the radio to switch from RX to TX (or vice versa) after a packet, without calibration (approximate)
+	static constexpr std::chrono::microseconds TURNAROUND_TIME{50};
+
+	/// Extra time allowed in every timeout, to cover SPI transactions and interrupt latency on our end
+	static constexpr std::chrono::microseconds TIMEOUT_SLACK{1000};
+
+	explicit LinkTiming(RadioSettings const & settings);
+
+	/**
+	 * @return Time to send one bit over the air
+	 */
+	std::chrono::nanoseconds getBitTime() const
+	{
+		return bitTime;
+	}
+
+	/**
+	 * @return Number of preamble bits sent before each packet
+	 */
+	size_t getPreambleBits() const;
+
+	/**
+	 * @return Number of sync word bits sent before each packet
+	 */
+	size_t getSyncBits() const;
+
+	/**
+	 * @return Time taken by the preamble and sync word at the start of every transmission
+	 */
+	std::chrono::nanoseconds getOverheadTime() const;
+
+	/**
+	 * @return Time taken to send numBytes bytes of raw data (no framing)
+	 */
+	std::chrono::nanoseconds getDataTime(size_t numBytes) const;
+
+	/**
+	 * Get the total airtime of a packet, including preamble, sync word, length field and CRC
+	 * (depending on the packet mode).
+	 * @param payloadLen Length of the packet payload in bytes
+	 */
+	std::chrono::nanoseconds getPacketAirtime(size_t payloadLen) const;
+
+	/**
+	 * Get the expected time from the start of transmitting a request until a response has been
+	 * fully received, when the other radio responds automatically via its on-receive state.
+	 * @param responder Timing of the responding radio
+	 */
+	std::chrono::nanoseconds getExchangeTime(size_t requestLen, LinkTiming const & responder, size_t responseLen) const;
+
+	/**
+	 * Get a timeout to use for an operation which is expected to take the given amount of time.
+	 * Allows double the expected time plus a fixed slack, so it's still tight enough to
+	 * detect failures quickly.
+	 */
+	static std::chrono::microseconds getTimeout(std::chrono::nanoseconds expectedTime);
+
+private:
+
+	RadioSettings settings;
+	std::chrono::nanoseconds bitTime;
+};
+
+#endif //LIGHTSPEEDRANGEFINDER_LINKTIMING_H
@@ -0,0 +1,209 @@
+//
+// Fixed RAM budget for test buffers, an optional zero-heap mode, and a report of RAM and stack use.
+//
+
+#include "MemoryBudget.h"
+
+#include <cinttypes>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	ArenaBase * firstArena = nullptr;
+	BudgetedGlobal * firstGlobal = nullptr;
+
+	bool heapLocked = false;
+
+	// Total bytes ever allocated when the heap was locked.  The allocation count can't be used, since it goes down on free.
+	uint32_t heapBytesAtLock = 0;
+
+#if MBED_STACK_STATS_ENABLED
+	const size_t maxThreads = 8;
+	mbed_stats_stack_t threadStackStats[maxThreads];
+#endif
+
+#if ZERO_HEAP
+	/**
+	 * @param canFail Whether to return nullptr when out of memory (nothrow new) instead of trapping
+	 */
+	void * checkedAllocate(size_t size, bool canFail)
+	{
+		if(heapLocked)
+		{
+			MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_OUT_OF_MEMORY), "Heap allocation in zero-heap mode");
+		}
+
+		void * memory = malloc(size);
+		if(memory == nullptr && !canFail)
+		{
+			MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_OUT_OF_MEMORY), "Out of heap");
+		}
+		return memory;
+	}
+#endif
+}
+
+#if ZERO_HEAP
+// Replace the global allocation functions so that allocations after lockHeap() trap
+void * operator new(size_t size)
+{
+	return checkedAllocate(size, false);
+}
+
+void * operator new[](size_t size)
+{
+	return checkedAllocate(size, false);
+}
+
+void * operator new(size_t size, std::nothrow_t const &) noexcept
+{
+	return checkedAllocate(size, true);
+}
+
+void * operator new[](size_t size, std::nothrow_t const &) noexcept
+{
+	return checkedAllocate(size, true);
+}
+
+void operator delete(void * memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void * memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void * memory, size_t) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void * memory, size_t) noexcept
+{
+	free(memory);
+}
+#endif
+
+ArenaBase::ArenaBase(char const * name, size_t capacity):
+name(name),
+capacity(capacity),
+used(0),
+next(nullptr)
+{
+	MemoryBudget::Internal::registerArena(this);
+}
+
+void * ArenaBase::allocateBytes(size_t size, uint8_t * storage)
+{
+	if(size > capacity - used)
+	{
+		MemoryBudget::Internal::arenaFull(this);
+	}
+
+	void * buffer = storage + used;
+	used += size;
+	return buffer;
+}
+
+BudgetedGlobal::BudgetedGlobal(char const * name, size_t size):
+name(name),
+size(size),
+next(nullptr)
+{
+	MemoryBudget::Internal::registerGlobal(this);
+}
+
+void MemoryBudget::Internal::registerArena(ArenaBase * arena)
+{
+	arena->next = firstArena;
+	firstArena = arena;
+}
+
+void MemoryBudget::Internal::registerGlobal(BudgetedGlobal * global)
+{
+	global->next = firstGlobal;
+	firstGlobal = global;
+}
+
+void MemoryBudget::Internal::arenaFull(ArenaBase const * arena)
+{
+	// Arenas are filled at init, so this always happens on the first run after a buffer grows
+	MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_OUT_OF_MEMORY), arena->getName());
+	while(true){}
+}
+
+void MemoryBudget::lockHeap()
+{
+#if MBED_HEAP_STATS_ENABLED
+	mbed_stats_heap_t heapStats;
+	mbed_stats_heap_get(&heapStats);
+	heapBytesAtLock = heapStats.total_size;
+#endif
+	heapLocked = true;
+}
+
+uint32_t MemoryBudget::getHeapBytesSinceLock()
+{
+#if MBED_HEAP_STATS_ENABLED
+	if(heapLocked)
+	{
+		mbed_stats_heap_t heapStats;
+		mbed_stats_heap_get(&heapStats);
+		return heapStats.total_size - heapBytesAtLock;
+	}
+#endif
+	return 0;
+}
+
+void MemoryBudget::printReport(Stream & pc, char const * testName)
+{
+	pc.printf(">> Memory report for %s:\n", testName);
+
+	// Arenas are filled at init, so their capacity is what they use
+	size_t totalBytes = 0;
+	for(ArenaBase * arena = firstArena; arena != nullptr; arena = arena->next)
+	{
+		pc.printf("Arena %s: %zu bytes\n", arena->getName(), arena->getCapacity());
+		totalBytes += arena->getCapacity();
+	}
+	for(BudgetedGlobal * global = firstGlobal; global != nullptr; global = global->next)
+	{
+		pc.printf("Global %s: %zu bytes\n", global->getName(), global->getSize());
+		totalBytes += global->getSize();
+	}
+	pc.printf("Budget total: %zu of %zu bytes\n", totalBytes, static_cast<size_t>(MEMORY_BUDGET_ARENA_BYTES));
+	if(totalBytes > MEMORY_BUDGET_ARENA_BYTES)
+	{
+		pc.printf(">> ERROR: Test buffers are over the RAM budget\n");
+	}
+
+#if MBED_HEAP_STATS_ENABLED
+	mbed_stats_heap_t heapStats;
+	mbed_stats_heap_get(&heapStats);
+	pc.printf("Heap: %" PRIu32 " bytes in use, peak %" PRIu32 " bytes, heap size %" PRIu32 " bytes, %" PRIu32 " failed allocations\n",
+		heapStats.current_size, heapStats.max_size, heapStats.reserved_size, heapStats.alloc_fail_cnt);
+
+	const uint32_t heapBytesSinceLock = getHeapBytesSinceLock();
+	if(heapBytesSinceLock > 0)
+	{
+		pc.printf(">> ERROR: %" PRIu32 " bytes allocated on the heap after init\n", heapBytesSinceLock);
+	}
+#else
+	pc.printf("Heap: enable MBED_HEAP_STATS_ENABLED for heap usage\n");
+#endif
+
+#if MBED_STACK_STATS_ENABLED
+	size_t numThreads = mbed_stats_stack_get_each(threadStackStats, maxThreads);
+	for(size_t threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+	{
+		mbed_stats_stack_t const & stackStats = threadStackStats[threadIndex];
+		pc.printf("Stack of thread 0x%08" PRIx32 ": peak %" PRIu32 " of %" PRIu32 " bytes\n",
+			stackStats.thread_id, stackStats.max_size, stackStats.reserved_size);
+	}
+#else
+	pc.printf("Stack: enable MBED_STACK_STATS_ENABLED for stack usage\n");
+#endif
+}
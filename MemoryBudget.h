@@ -0,0 +1,157 @@
+//
+// Fixed RAM budget for test buffers, an optional zero-heap mode, and a report of RAM and stack use.
+//
+
+#ifndef LIGHTSPEEDRANGEFINDER_MEMORYBUDGET_H
+#define LIGHTSPEEDRANGEFINDER_MEMORYBUDGET_H
+
+#include <mbed.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// RAM that one test program's arenas and budgeted globals may use, in bytes.  Override with a macro in mbed_app.json to match the MCU.
+// This only covers test buffers.  The radio and serial driver objects, Mbed OS internals and thread stacks aren't part of it;
+// the heap and stacks are reported separately.
+#ifndef MEMORY_BUDGET_ARENA_BYTES
+#define MEMORY_BUDGET_ARENA_BYTES (64 * 1024)
+#endif
+
+// Set to 1 to trap any C++ heap allocation made after MemoryBudget::lockHeap()
+#ifndef ZERO_HEAP
+#define ZERO_HEAP 0
+#endif
+
+class ArenaBase;
+class BudgetedGlobal;
+
+namespace MemoryBudget
+{
+	/**
+	 * Call once init is done (radios set up, threads started).  In zero-heap mode, any operator new after this traps.
+	 * In either mode, heap allocations made after this are counted and flagged in the report (needs heap stats enabled).
+	 */
+	void lockHeap();
+
+	/**
+	 * @return Bytes allocated on the heap since lockHeap(), including any freed again, or 0 if heap stats aren't enabled
+	 */
+	uint32_t getHeapBytesSinceLock();
+
+	/**
+	 * Print the arena, budgeted global, heap and stack usage so far.
+	 * Heap and stack numbers need MBED_HEAP_STATS_ENABLED and MBED_STACK_STATS_ENABLED.
+	 * @param testName Printed with the report, e.g. the test that just ran
+	 */
+	void printReport(Stream & pc, char const * testName);
+
+	/**
+	 * @return Bytes needed in an arena for count objects of type T
+	 */
+	template<typename T>
+	constexpr size_t bytesFor(size_t count = 1)
+	{
+		return (sizeof(T) * count + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+	}
+
+	namespace Internal
+	{
+		void registerArena(ArenaBase * arena);
+		void registerGlobal(BudgetedGlobal * global);
+		[[noreturn]] void arenaFull(ArenaBase const * arena);
+	}
+}
+
+/**
+ * Untyped part of StaticArena, so that the report can list every arena.
+ */
+class ArenaBase
+{
+public:
+	char const * getName() const { return name; }
+	size_t getCapacity() const { return capacity; }
+
+protected:
+	ArenaBase(char const * name, size_t capacity);
+
+	// Bump allocate.  Traps if the arena is full, since the arena size is supposed to cover every allocation.
+	void * allocateBytes(size_t size, uint8_t * storage);
+
+private:
+	friend void MemoryBudget::Internal::registerArena(ArenaBase * arena);
+	friend void MemoryBudget::printReport(Stream & pc, char const * testName);
+
+	char const * name;
+	size_t capacity;
+	size_t used;
+
+	ArenaBase * next;
+};
+
+/**
+ * Statically allocated block of RAM that test buffers are carved out of at init.
+ * Size it with MemoryBudget::bytesFor(), so that the build fails if the buffers grow past the budget:
+ *
+ *   StaticArena<MemoryBudget::bytesFor<int64_t>(numTrials) + MemoryBudget::bytesFor<char>(bufferLen)> arena("TestJitter");
+ *   int64_t * roundtripTimes = arena.allocate<int64_t>(numTrials);
+ *
+ * Memory is never freed, so buffers should be allocated once, e.g. as globals.
+ */
+template<size_t SIZE>
+class StaticArena : public ArenaBase
+{
+public:
+	static_assert(SIZE <= MEMORY_BUDGET_ARENA_BYTES, "Arena is over the RAM budget, see MEMORY_BUDGET_ARENA_BYTES");
+
+	static constexpr size_t CAPACITY = SIZE;
+
+	explicit StaticArena(char const * name):
+	ArenaBase(name, SIZE)
+	{}
+
+	/**
+	 * Allocate a zeroed buffer of count objects.  Only for plain data, since no constructors or destructors are run.
+	 */
+	template<typename T>
+	T * allocate(size_t count = 1)
+	{
+		static_assert(std::is_trivially_default_constructible<T>::value && std::is_trivially_destructible<T>::value,
+			"Arenas only hold plain data");
+
+		void * buffer = allocateBytes(MemoryBudget::bytesFor<T>(count), storage);
+		memset(buffer, 0, sizeof(T) * count);
+		return static_cast<T *>(buffer);
+	}
+
+private:
+	alignas(std::max_align_t) uint8_t storage[SIZE];
+};
+
+/**
+ * Counts a global which can't live in an arena (e.g. because it has constructors) towards the budget,
+ * and lists it in the report:
+ *
+ *   TimeSeriesStore<int16_t, 3, 256, 300, 360> linkHistory;
+ *   BudgetedGlobal linkHistoryBudget("linkHistory", sizeof(linkHistory));
+ */
+class BudgetedGlobal
+{
+public:
+	BudgetedGlobal(char const * name, size_t size);
+
+	char const * getName() const { return name; }
+	size_t getSize() const { return size; }
+
+private:
+	friend void MemoryBudget::Internal::registerGlobal(BudgetedGlobal * global);
+	friend void MemoryBudget::printReport(Stream & pc, char const * testName);
+
+	char const * name;
+	size_t size;
+
+	BudgetedGlobal * next;
+};
+
+#endif //LIGHTSPEEDRANGEFINDER_MEMORYBUDGET_H
@@ -0,0 +1,269 @@
+//
+// On-off keying waveform engine.
+//
+
+#include "OOKWaveform.h"
+
+#include <mbed.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace
+{
+	// Morse code for A-Z then 0-9
+	char const * const morseTable[] = {
+		".-", "-...", "-.-.", "-..", ".", "..-.", "--.", "....", "..", ".---", "-.-", ".-..", "--",
+		"-.", "---", ".--.", "--.-", ".-.", "...", "-", "..-", "...-", ".--", "-..-", "-.--", "--..",
+		"-----", ".----", "..---", "...--", "....-", ".....", "-....", "--...", "---..", "----."
+	};
+
+	/**
+	 * @return Morse code for the given character, or nullptr if there isn't one
+	 */
+	char const * getMorseCode(char character)
+	{
+		character = static_cast<char>(toupper(static_cast<unsigned char>(character)));
+		if(character >= 'A' && character <= 'Z')
+		{
+			return morseTable[character - 'A'];
+		}
+		if(character >= '0' && character <= '9')
+		{
+			return morseTable[26 + (character - '0')];
+		}
+		return nullptr;
+	}
+}
+
+constexpr size_t OOKWaveform::MAX_BYTES;
+constexpr size_t OOKWaveform::MAX_POWER_STEPS;
+
+OOKWaveform::OOKWaveform(float symbolRate):
+symbolRate(symbolRate),
+bits(),
+numBits(0),
+powerSteps(),
+numPowerSteps(0)
+{
+}
+
+void OOKWaveform::clear()
+{
+	memset(bits, 0, sizeof(bits));
+	numBits = 0;
+	numPowerSteps = 0;
+}
+
+bool OOKWaveform::addOn(std::chrono::microseconds duration)
+{
+	return addBits(true, durationToBits(duration));
+}
+
+bool OOKWaveform::addOff(std::chrono::microseconds duration)
+{
+	return addBits(false, durationToBits(duration));
+}
+
+bool OOKWaveform::addDutyCycle(std::chrono::microseconds period, std::chrono::microseconds onTime, size_t numPeriods)
+{
+	const size_t periodBits = durationToBits(period);
+	const size_t onBits = std::min(durationToBits(onTime), periodBits);
+
+	if(numBits + periodBits * numPeriods > MAX_BYTES * 8)
+	{
+		return false;
+	}
+
+	for(size_t periodIndex = 0; periodIndex < numPeriods; ++periodIndex)
+	{
+		addBits(true, onBits);
+		addBits(false, periodBits - onBits);
+	}
+	return true;
+}
+
+bool OOKWaveform::addMorse(char const * message, std::chrono::microseconds dotTime)
+{
+	const size_t dotBits = durationToBits(dotTime);
+	const size_t startBits = numBits;
+
+	bool success = true;
+	bool firstLetter = true;
+	for(char const * character = message; *character != '\0' && success; ++character)
+	{
+		if(*character == ' ')
+		{
+			// 7 dot word gap, 3 of which come from the letter gap below
+			success = addBits(false, 4 * dotBits);
+			continue;
+		}
+
+		char const * code = getMorseCode(*character);
+		if(code == nullptr)
+		{
+			continue;
+		}
+
+		if(!firstLetter)
+		{
+			success = addBits(false, 3 * dotBits);
+		}
+		firstLetter = false;
+
+		for(char const * element = code; *element != '\0' && success; ++element)
+		{
+			if(element != code)
+			{
+				success = addBits(false, dotBits);
+			}
+			success = success && addBits(true, *element == '-' ? 3 * dotBits : dotBits);
+		}
+	}
+
+	if(!success)
+	{
+		// roll back the partial message
+		const size_t keepBytes = (startBits + 7) / 8;
+		if(startBits % 8 != 0)
+		{
+			bits[startBits / 8] &= static_cast<uint8_t>(0xFF << (8 - startBits % 8));
+		}
+		memset(bits + keepBytes, 0, MAX_BYTES - keepBytes);
+		numBits = startBits;
+	}
+	return success;
+}
+
+bool OOKWaveform::addPowerStep(float outputPower)
+{
+	if(numPowerSteps == MAX_POWER_STEPS)
+	{
+		return false;
+	}
+
+	if(numBits > 0)
+	{
+		const size_t paddingBits = (8 - numBits % 8) % 8 + 8;
+		if(!addBits(false, paddingBits))
+		{
+			return false;
+		}
+	}
+
+	powerSteps[numPowerSteps].byteIndex = numBits / 8;
+	powerSteps[numPowerSteps].outputPower = outputPower;
+	++numPowerSteps;
+	return true;
+}
+
+void OOKWaveform::configureRadio(CC1200 & radio) const
+{
+	radio.setPacketMode(CC1200::PacketMode::INFINITE_LENGTH, false);
+	radio.setCRCEnabled(false);
+
+	radio.setSymbolRate(symbolRate);
+
+	// disable anything getting sent before the data
+	radio.configureSyncWord(0x0, CC1200::SyncMode::SYNC_NONE, 8);
+	radio.configurePreamble(0, 0);
+
+	// configure OOK modulation
+	radio.setModulationFormat(CC1200::ModFormat::ASK);
+	radio.disablePARamping();
+}
+
+bool OOKWaveform::transmit(CC1200 & radio) const
+{
+	const size_t numBytes = getNumBytes();
+	if(numBytes == 0)
+	{
+		return true;
+	}
+
+	radio.sendCommand(CC1200::Command::IDLE);
+	radio.sendCommand(CC1200::Command::FLUSH_TX);
+
+	size_t stepIndex = 0;
+	while(stepIndex < numPowerSteps && powerSteps[stepIndex].byteIndex == 0)
+	{
+		radio.setOutputPower(powerSteps[stepIndex].outputPower);
+		++stepIndex;
+	}
+
+	auto getChunkEnd = [&]()
+	{
+		return stepIndex < numPowerSteps ? powerSteps[stepIndex].byteIndex : numBytes;
+	};
+
+	char const * data = reinterpret_cast<char const *>(bits);
+
+	// fill the FIFO before starting so that it doesn't underflow straight away
+	size_t byteIndex = radio.writeStream(data, getChunkEnd());
+
+	radio.startTX();
+
+	bool success = true;
+	while(byteIndex < numBytes && success)
+	{
+		const size_t chunkEnd = getChunkEnd();
+		if(byteIndex < chunkEnd)
+		{
+			success = radio.writeStreamBlocking(data + byteIndex, chunkEnd - byteIndex);
+			byteIndex = chunkEnd;
+		}
+
+		// Once the FIFO is empty, the padding byte before the power step is being sent, so the carrier is off
+		// and there's a whole byte time to change the power before the FIFO underflows.
+		if(success && stepIndex < numPowerSteps && byteIndex == powerSteps[stepIndex].byteIndex)
+		{
+			while(radio.getTXFIFOLen() > 0)
+			{}
+			while(stepIndex < numPowerSteps && powerSteps[stepIndex].byteIndex == byteIndex)
+			{
+				radio.setOutputPower(powerSteps[stepIndex].outputPower);
+				++stepIndex;
+			}
+		}
+	}
+
+	// let the last byte get out of the modulator before shutting off
+	while(radio.getTXFIFOLen() > 0)
+	{}
+	wait_us(static_cast<int>(8e6f / symbolRate));
+
+	radio.sendCommand(CC1200::Command::IDLE);
+	radio.sendCommand(CC1200::Command::FLUSH_TX);
+
+	return success;
+}
+
+std::chrono::microseconds OOKWaveform::getDuration() const
+{
+	return std::chrono::microseconds(static_cast<int64_t>(numBits * 1e6 / symbolRate));
+}
+
+bool OOKWaveform::addBits(bool on, size_t count)
+{
+	if(numBits + count > MAX_BYTES * 8)
+	{
+		return false;
+	}
+
+	if(on)
+	{
+		for(size_t bitIndex = numBits; bitIndex < numBits + count; ++bitIndex)
+		{
+			// sent MSB first
+			bits[bitIndex / 8] |= static_cast<uint8_t>(0x80 >> (bitIndex % 8));
+		}
+	}
+	numBits += count;
+	return true;
+}
+
+size_t OOKWaveform::durationToBits(std::chrono::microseconds duration) const
+{
+	return static_cast<size_t>(duration.count() * symbolRate / 1e6f + 0.5f);
+}
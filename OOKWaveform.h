@@ -0,0 +1,113 @@
+//
+// On-off keying waveform engine.  Compiles a schedule of on and off times into a bit buffer,
+// then streams it out of the radio in infinite length mode so the radio does all of the timing.
+//
+
+#ifndef LIGHTSPEEDRANGEFINDER_OOKWAVEFORM_H
+#define LIGHTSPEEDRANGEFINDER_OOKWAVEFORM_H
+
+#include <CC1200.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Bit buffer holding an OOK schedule, where each bit is one symbol: 1 for carrier on, 0 for carrier off.
+ *
+ * Build a waveform with the add functions, then call configureRadio() once and transmit() as many times
+ * as needed.  Durations are rounded to the nearest symbol, so the symbol rate sets the timing resolution.
+ * If an add function runs out of space it returns false and the waveform is left unchanged.
+ */
+class OOKWaveform
+{
+public:
+
+	// Buffer size.  At 1 ksps this holds about 32 seconds.
+	static constexpr size_t MAX_BYTES = 4096;
+
+	static constexpr size_t MAX_POWER_STEPS = 16;
+
+	/**
+	 * @param symbolRate Symbol rate to send the waveform at, in symbols per second.
+	 */
+	explicit OOKWaveform(float symbolRate = 1000);
+
+	/**
+	 * Remove everything from the waveform.
+	 */
+	void clear();
+
+	bool addOn(std::chrono::microseconds duration);
+
+	bool addOff(std::chrono::microseconds duration);
+
+	/**
+	 * Add a number of on-then-off periods.
+	 */
+	bool addDutyCycle(std::chrono::microseconds period, std::chrono::microseconds onTime, size_t numPeriods);
+
+	/**
+	 * Add a Morse code message, using standard timing: dash is 3 dots, 1 dot between elements,
+	 * 3 between letters and 7 between words.  Letters and digits only, anything else is skipped.
+	 * @param dotTime Length of one dot
+	 */
+	bool addMorse(char const * message, std::chrono::microseconds dotTime);
+
+	/**
+	 * Change the output power from this point of the waveform on.
+	 *
+	 * The power register can only be written while the previous byte of the waveform is still being sent,
+	 * so this pads the waveform with off time to a byte boundary plus one more byte of off time.
+	 * A power step at the very start of the waveform is applied before the transmission starts.
+	 */
+	bool addPowerStep(float outputPower);
+
+	/**
+	 * Set up the radio to send this waveform: ASK modulation, infinite length mode,
+	 * no preamble or sync word, and this waveform's symbol rate.
+	 */
+	void configureRadio(CC1200 & radio) const;
+
+	/**
+	 * Send the waveform, and return once the last symbol has gone out and the radio is idle again.
+	 * @return false if the radio had an error while streaming
+	 */
+	bool transmit(CC1200 & radio) const;
+
+	size_t getNumBits() const { return numBits; }
+
+	size_t getNumBytes() const { return (numBits + 7) / 8; }
+
+	/**
+	 * @return Time the waveform takes to send, not counting the radio's startup time
+	 */
+	std::chrono::microseconds getDuration() const;
+
+	float getSymbolRate() const { return symbolRate; }
+
+private:
+
+	struct PowerStep
+	{
+		size_t byteIndex;
+		float outputPower;
+	};
+
+	float symbolRate;
+
+	uint8_t bits[MAX_BYTES];
+	size_t numBits;
+
+	PowerStep powerSteps[MAX_POWER_STEPS];
+	size_t numPowerSteps;
+
+	/**
+	 * Append bits, all on or all off.
+	 */
+	bool addBits(bool on, size_t count);
+
+	size_t durationToBits(std::chrono::microseconds duration) const;
+};
+
+#endif //LIGHTSPEEDRANGEFINDER_OOKWAVEFORM_H
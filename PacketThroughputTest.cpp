@@ -0,0 +1,389 @@
+//
+// Test program which measures packet mode throughput using the flight packet format
+// (variable length with CRC and a 32-bit sync word).  For each radio config it sweeps payload length,
+// preamble length and how many packets are queued back to back, to find the best packet size for telemetry.
+//
+
+#include <mbed.h>
+#include <SerialStream.h>
+
+#include <CC1200.h>
+#include <algorithm>
+#include <cinttypes>
+
+#include "../RangingTimer.h"
+#include "../pins.h"
+
+#include "LinkTiming.h"
+#include "MemoryBudget.h"
+#include "RadioSettingsMenu.h"
+
+BufferedSerial serial(USBTX, USBRX, 115200);
+SerialStream<BufferedSerial> pc(serial);
+
+CC1200 txRadio(PIN_RADIO_SPI_MOSI, PIN_RADIO_SPI_MISO, PIN_RADIO_SPI_SCLK, PIN_RADIO_CS, PIN_RADIO_RST, &pc);
+CC1200 rxRadio(PIN_RADIO_SPI_MOSI, PIN_RADIO_SPI_MISO, PIN_RADIO_SPI_SCLK, PIN_RADIO_DUMMY_CS, PIN_RADIO_DUMMY_RST, &pc);
+
+// Same roles as in TestJitter: the ground station radio's sync output is captured as the TX time,
+// and the transponder radio's sync output is captured as the RX time.
+CC1200 & sender = rxRadio;
+CC1200 & receiver = txRadio;
+
+const size_t fifoLen = 128;
+
+// Sweep parameters
+const size_t payloadLengths[] = {8, 16, 32, 64, 120};
+const uint8_t preambleLengthCfgs[] = {2, 4, 5, 7}; // 1, 2, 3 and 5 bytes
+const size_t queueDepths[] = {1, 2, 4, 8};
+const size_t burstsPerPoint = 20;
+
+const size_t numConfigs = 10;
+
+// Packet buffers, sized for a packet that fills the FIFO
+StaticArena<2 * MemoryBudget::bytesFor<char>(fifoLen)> testArena("PacketThroughputTest");
+char * const txPacket = testArena.allocate<char>(fifoLen);
+char * const rxPacket = testArena.allocate<char>(fifoLen);
+
+int senderBoardRevision = -1;
+int receiverBoardRevision = -1;
+
+/**
+ * Results for one point of the sweep
+ */
+struct PointResult
+{
+	size_t packetsSent = 0;
+	size_t packetsReceived = 0; // received with correct contents
+	size_t packetsCRCFailed = 0; // received, but failed CRC
+	size_t packetsCorrupt = 0; // passed CRC, but contents were wrong
+	std::chrono::microseconds elapsedTime{0};
+
+	// Per packet latencies, from the ranging timer, over the packets received with correct contents.
+	// Sync latency is from the sender's sync word to the receiver's sync word, delivery latency is from the
+	// sender's sync word to the whole packet being in the receiver's FIFO.
+	size_t latencyCount = 0;
+	int64_t syncLatencySum = 0; // ns
+	int64_t syncLatencyMax = 0; // ns
+	int64_t deliveryLatencySum = 0; // ns
+	int64_t deliveryLatencyMax = 0; // ns
+};
+
+/**
+ * Fill a packet with a sequence number followed by a known pattern.
+ */
+void fillPacket(char * packet, size_t payloadLen, uint8_t sequence)
+{
+	packet[0] = static_cast<char>(sequence);
+	for(size_t index = 1; index < payloadLen; ++index)
+	{
+		packet[index] = static_cast<char>(sequence + index);
+	}
+}
+
+/**
+ * Check that a received packet matches what fillPacket() would have produced.
+ */
+bool checkPacket(char const * packet, size_t receivedLen, size_t payloadLen)
+{
+	if(receivedLen != payloadLen)
+	{
+		return false;
+	}
+
+	uint8_t sequence = static_cast<uint8_t>(packet[0]);
+	for(size_t index = 1; index < payloadLen; ++index)
+	{
+		if(static_cast<uint8_t>(packet[index]) != static_cast<uint8_t>(sequence + index))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Calibrate the frequency synthesizers of both radios, since the configs don't turn on auto calibration.
+ */
+void calibrateRadios()
+{
+	sender.sendCommand(CC1200::Command::CAL_FREQ_SYNTH);
+	receiver.sendCommand(CC1200::Command::CAL_FREQ_SYNTH);
+	ThisThread::sleep_for(1ms);
+	while(sender.getState() == CC1200::State::CALIBRATE || receiver.getState() == CC1200::State::CALIBRATE)
+	{}
+}
+
+/**
+ * Apply a radio config to one radio, with the flight packet format and the given preamble.
+ */
+void configureRadio(CC1200 & radio, int config, int boardRevision, uint8_t preambleLengthCfg, RadioSettings & settings)
+{
+	applyRadioConfig(radio, config, settings);
+	applyBoardRevision(radio, boardRevision, settings);
+
+	radio.setPacketMode(CC1200::PacketMode::VARIABLE_LENGTH);
+	radio.setCRCEnabled(true);
+	radio.configureSyncWord(0x930B51DE, CC1200::SyncMode::SYNC_32_BITS, 8);
+	radio.configurePreamble(preambleLengthCfg, 0);
+
+	// Keep packets which fail CRC in the RX FIFO (FIFO_CFG.CRC_AUTOFLUSH) so that they can be counted
+	radio.writeRegister(CC1200::Register::FIFO_CFG, radio.readRegister(CC1200::Register::FIFO_CFG) & ~0x80);
+
+	settings.packetMode = CC1200::PacketMode::VARIABLE_LENGTH;
+	settings.crcEnabled = true;
+	settings.syncMode = CC1200::SyncMode::SYNC_32_BITS;
+	settings.preambleLengthCfg = preambleLengthCfg;
+}
+
+/**
+ * Send bursts of back to back packets and measure what comes out the other end.
+ */
+PointResult runPoint(RadioSettings const & senderSettings, size_t payloadLen, size_t queueDepth)
+{
+	PointResult result;
+
+	LinkTiming senderTiming(senderSettings);
+	const auto packetAirtime = senderTiming.getPacketAirtime(payloadLen);
+	const auto burstTimeout = LinkTiming::getTimeout(packetAirtime * queueDepth + LinkTiming::IDLE_TO_ACTIVE_TIME);
+
+	uint8_t sequence = 0;
+
+	receiver.startRX();
+
+	for(size_t burstIndex = 0; burstIndex < burstsPerPoint; ++burstIndex)
+	{
+		// Queue up the whole burst first, so the sender can send it back to back
+		for(size_t packetIndex = 0; packetIndex < queueDepth; ++packetIndex)
+		{
+			fillPacket(txPacket, payloadLen, sequence++);
+			sender.enqueuePacket(txPacket, payloadLen);
+		}
+		result.packetsSent += queueDepth;
+
+		rangingTimer.reset();
+		Timer burstTimer;
+		burstTimer.start();
+		sender.startTX();
+
+		size_t packetsInBurst = 0;
+		while(packetsInBurst < queueDepth && burstTimer.elapsed_time() < burstTimeout)
+		{
+			if(!receiver.hasReceivedPacket())
+			{
+				continue;
+			}
+
+			// Take this packet's sync captures and re-arm the timer straight away, since the next packet's
+			// sync word is only a preamble and sync word later.
+			const int64_t deliveryTime = rangingTimer.getCurrentTime().count();
+			const bool capturesValid = rangingTimer.hasSeenTransmission() && rangingTimer.hasReceivedResponse();
+			const int64_t txTime = rangingTimer.getTxCapturedTime().count();
+			const int64_t rxTime = rangingTimer.getRxCapturedTime().count();
+			rangingTimer.reset();
+
+			// LQI_VAL.PKT_CRC_OK is for the last packet received.  Reading a packet out takes a fraction of its airtime,
+			// so this is the packet that was just detected.
+			const bool crcOK = receiver.readRegister(CC1200::ExtRegister::LQI_VAL) & 0x80;
+
+			size_t receivedLen = receiver.receivePacket(rxPacket, fifoLen);
+			if(!crcOK)
+			{
+				++result.packetsCRCFailed;
+			}
+			else if(checkPacket(rxPacket, receivedLen, payloadLen))
+			{
+				++result.packetsReceived;
+
+				// If the re-arm was late, the captures pair up the wrong edges, which is at least a packet apart
+				const int64_t syncLatency = rxTime - txTime;
+				if(capturesValid && syncLatency >= 0 && syncLatency < packetAirtime.count())
+				{
+					const int64_t deliveryLatency = deliveryTime - txTime;
+					++result.latencyCount;
+					result.syncLatencySum += syncLatency;
+					result.syncLatencyMax = std::max(result.syncLatencyMax, syncLatency);
+					result.deliveryLatencySum += deliveryLatency;
+					result.deliveryLatencyMax = std::max(result.deliveryLatencyMax, deliveryLatency);
+				}
+			}
+			else
+			{
+				++result.packetsCorrupt;
+			}
+			++packetsInBurst;
+		}
+		result.elapsedTime += burstTimer.elapsed_time();
+
+		// Reset both radios for the next burst.  Anything still in flight counts as lost.
+		sender.idle();
+		sender.sendCommand(CC1200::Command::FLUSH_TX);
+		receiver.idle();
+		receiver.sendCommand(CC1200::Command::FLUSH_RX);
+		receiver.startRX();
+	}
+
+	receiver.idle();
+	return result;
+}
+
+/**
+ * Run the sweep for one radio config.
+ */
+void sweepConfig(int config)
+{
+	pc.printf("\n---------------------------------\n");
+	pc.printf("Sweeping config %d\n", config);
+
+	float bestGoodput = 0;
+	size_t bestPayloadLen = 0;
+	size_t bestPreambleBits = 0;
+	size_t bestQueueDepth = 0;
+
+	for(uint8_t preambleLengthCfg : preambleLengthCfgs)
+	{
+		RadioSettings senderSettings;
+		RadioSettings receiverSettings;
+		configureRadio(sender, config, senderBoardRevision, preambleLengthCfg, senderSettings);
+		configureRadio(receiver, config, receiverBoardRevision, preambleLengthCfg, receiverSettings);
+
+		sender.setOnTransmitState(CC1200::State::TX); // keep going with the next queued packet
+		receiver.setOnReceiveState(CC1200::State::RX, CC1200::State::RX);
+
+		sender.configureGPIO(0, CC1200::GPIOMode::PKT_SYNC_RXTX);
+		sender.configureGPIO(2, CC1200::GPIOMode::PKT_SYNC_RXTX);
+		receiver.configureGPIO(2, CC1200::GPIOMode::PKT_SYNC_RXTX);
+
+		calibrateRadios();
+
+		const size_t preambleBits = LinkTiming(senderSettings).getPreambleBits();
+
+		for(size_t payloadLen : payloadLengths)
+		{
+			for(size_t queueDepth : queueDepths)
+			{
+				// whole burst has to fit in the TX FIFO, including the length byte of each packet
+				if(queueDepth * (payloadLen + 1) > fifoLen)
+				{
+					continue;
+				}
+
+				PointResult result = runPoint(senderSettings, payloadLen, queueDepth);
+
+				const float elapsedSeconds = result.elapsedTime.count() / 1e6f;
+				const float packetsPerSecond = result.packetsReceived / elapsedSeconds;
+				const float goodput = packetsPerSecond * payloadLen * 8;
+				const size_t packetsLost = result.packetsSent - result.packetsReceived - result.packetsCRCFailed - result.packetsCorrupt;
+				const float lossPercent = 100.0f * packetsLost / result.packetsSent;
+				const float crcFailPercent = 100.0f * result.packetsCRCFailed / result.packetsSent;
+
+				int64_t syncLatency = -1;
+				int64_t syncLatencyMax = -1;
+				int64_t deliveryLatency = -1;
+				int64_t deliveryLatencyMax = -1;
+				if(result.latencyCount > 0)
+				{
+					syncLatency = result.syncLatencySum / static_cast<int64_t>(result.latencyCount);
+					syncLatencyMax = result.syncLatencyMax;
+					deliveryLatency = result.deliveryLatencySum / static_cast<int64_t>(result.latencyCount) / 1000;
+					deliveryLatencyMax = result.deliveryLatencyMax / 1000;
+				}
+
+				pc.printf("PKT,%d,%zu,%zu,%zu,%zu,%zu,%zu,%.02f,%.02f,%.01f,%.00f,%zu,%" PRIi64 ",%" PRIi64 ",%" PRIi64 ",%" PRIi64 "\n",
+					config, preambleBits, payloadLen, queueDepth, result.packetsSent, result.packetsReceived, result.packetsCorrupt,
+					lossPercent, crcFailPercent, packetsPerSecond, goodput, result.latencyCount,
+					syncLatency, syncLatencyMax, deliveryLatency, deliveryLatencyMax);
+
+				if(goodput > bestGoodput)
+				{
+					bestGoodput = goodput;
+					bestPayloadLen = payloadLen;
+					bestPreambleBits = preambleBits;
+					bestQueueDepth = queueDepth;
+				}
+			}
+		}
+	}
+
+	pc.printf("Best for config %d: payload %zu bytes, preamble %zu bits, queue depth %zu, goodput %.00f bps\n",
+		config, bestPayloadLen, bestPreambleBits, bestQueueDepth, bestGoodput);
+}
+
+void printHeader()
+{
+	// Lost packets are ones which were never detected at all.  Lost, CRC failed, corrupt and received packets add up to the packets sent.
+	// Latencies are the mean and max over the received packets whose sync captures could be paired up (latency_count).
+	pc.printf("PKT,config,preamble_bits,payload_len,queue_depth,sent,received,corrupt,loss_pct,crc_fail_pct,packets_per_s,goodput_bps,"
+		"latency_count,sync_latency_ns,sync_latency_max_ns,delivery_latency_us,delivery_latency_max_us\n");
+}
+
+void runFullSweep()
+{
+	printHeader();
+	for(int config = 1; config <= static_cast<int>(numConfigs); ++config)
+	{
+		sweepConfig(config);
+	}
+}
+
+void runSingleSweep()
+{
+	int config = -1;
+	pc.printf("Enter config to sweep (1-%zu): \n", numConfigs);
+	pc.scanf("%d", &config);
+	if(config < 1 || config > static_cast<int>(numConfigs))
+	{
+		pc.printf("Invalid entry.\n");
+		return;
+	}
+
+	printHeader();
+	sweepConfig(config);
+}
+
+int main()
+{
+	pc.printf("\nPacket Throughput Test Suite:\n");
+
+	pc.printf("Initializing CC1200s.....\n");
+	if(!sender.begin() || !receiver.begin())
+	{
+		pc.printf("ERROR: Failed to connect to CC1200s\n");
+		while(true){}
+	}
+	rangingTimer.begin();
+
+	pc.printf("Sending radio:\n");
+	senderBoardRevision = askForBoardRevision(pc);
+	pc.printf("Receiving radio:\n");
+	receiverBoardRevision = askForBoardRevision(pc);
+
+	// Tests shouldn't need the heap from here on
+	MemoryBudget::lockHeap();
+
+	while(1){
+		int test=-1;
+		//MENU. ADD AN OPTION FOR EACH TEST.
+		pc.printf("Select a test: \n");
+		pc.printf("1.  Exit Test Suite\n");
+		pc.printf("2.  Sweep all configs\n");
+		pc.printf("3.  Sweep one config\n");
+
+		pc.scanf("%d", &test);
+		printf("Running test %d:\n\n", test);
+		//SWITCH. ADD A CASE FOR EACH TEST.
+		switch(test) {
+			case 1:         pc.printf("Exiting test suite.\n");    return 0;
+			case 2:         runFullSweep();              break;
+			case 3:         runSingleSweep();              break;
+			default:        pc.printf("Invalid test number. Please run again.\n"); continue;
+		}
+
+		char testName[16];
+		snprintf(testName, sizeof(testName), "test %d", test);
+		MemoryBudget::printReport(pc, testName);
+
+		pc.printf("done.\r\n");
+	}
+
+	return 0;
+}
@@ -4,6 +4,8 @@
 
 #include "RadioSettingsMenu.h"
 
+#include "ConfigStore.h"
+
 void flightConfiguration(CC1200 & radio)
 {
 	// Radio settings (found through looooots of testing)
@@ -39,26 +41,8 @@ void flightConfiguration(CC1200 & radio)
 	radio.configureGPIO(2, CC1200::GPIOMode::PKT_SYNC_RXTX);
 }
 
-void askForRadioSettings(Stream& pc, CC1200 &radio)
+bool applyRadioConfig(CC1200 & radio, int config, RadioSettings & settings)
 {
-	int config=-1;
-	//MENU. ADD AN OPTION FOR EACH TEST.
-	pc.printf("Select a config: \n");
-	pc.printf("1.  38.4ksps 2-GFSK DEV=20kHz CHF=104kHz\n");
-	pc.printf("2.  38.4ksps 2-GFSK DEV=20kHz CHF=104kHz Max-IF\n");
-	pc.printf("3.  38.4ksps 2-GFSK DEV=20kHz CHF=104kHz Zero-IF\n");
-    pc.printf("4.  100ksps 2-GFSK DEV=50kHz CHF=208kHz\n");
-    pc.printf("5.  100ksps 2-GFSK DEV=50kHz CHF=208kHz Max-IF\n");
-    pc.printf("6.  100ksps 2-GFSK DEV=50kHz CHF=208kHz Zero-IF\n");
-    pc.printf("7.  500ksps 2-FSK DEV=125kHz CHF=833kHz\n");
-    pc.printf("8.  500ksps 2-FSK DEV=125kHz CHF=833kHz Max-IF\n");
-    pc.printf("9.  500ksps 2-FSK DEV=399kHz CHF=1666kHz Zero-IF\n");
-	pc.printf("10.  Flight Configuration\n");
-
-	config = 0;
-	pc.scanf("%d", &config);
-	pc.printf("Running test with config %d:\n\n", config);
-
 	CC1200::Band band = CC1200::Band::BAND_410_480MHz;
 	float frequency = 442e6;
 	float fskDeviation;
@@ -171,13 +155,26 @@ void askForRadioSettings(Stream& pc, CC1200 &radio)
 	{
 		flightConfiguration(radio);
 	}
-	else
-	{
-		pc.printf("Invalid entry.\n");
-	}
 
 	radio.configureFIFOMode();
 	radio.setPacketMode(CC1200::PacketMode::VARIABLE_LENGTH);
+
+	settings = RadioSettings();
+	settings.config = config;
+	if(config == 10)
+	{
+		// see flightConfiguration()
+		settings.symbolRate = 500000;
+		settings.modFormat = CC1200::ModFormat::FSK_2;
+	}
+	else if(config >= 1 && config <= 9)
+	{
+		settings.symbolRate = symbolRate;
+		settings.modFormat = modFormat;
+		settings.syncMode = syncMode;
+		settings.preambleLengthCfg = preableLengthCfg;
+	}
+
 	if(config != 10)
 	{
 		radio.configureDCFilter(dcOffsetCorrEnabled, dcFiltSettlingCfg, dcFiltCutoffCfg);
@@ -209,19 +206,25 @@ void askForRadioSettings(Stream& pc, CC1200 &radio)
 
 	radio.writeRegister(CC1200::ExtRegister::FS_DIG0,0xA3);
 
-	int boardRevision=-1;
-	//MENU. ADD AN OPTION FOR EACH TEST.
-	pc.printf("Select board revision: \n");
-	pc.printf("1.  RangefinderTest\n");
-	pc.printf("2.  Ground Station V1 +31.0dBm\n");
-	pc.printf("3.  Ground Station V1 +1.5dBm\n"); // used for receive sensitivity testing
-	pc.printf("4.  Transponder V1 +11.1dBm\n");
-	pc.printf("5.  Ground Station V2 +33dBm\n");
-	pc.printf("6.  Ground Station V2 -0.6 dBm\n");
-	pc.printf("7.  Ground Station V2 +23.5 dBm\n");
+	return config >= 1 && config <= 10;
+}
 
-	pc.scanf("%d", &boardRevision);
-	pc.printf("Running test with revision  %d:\n\n", boardRevision);
+uint8_t getBoardPreambleLengthCfg(int boardRevision)
+{
+	if(boardRevision == 4)
+	{
+		return 0b1011;
+	}
+	else if(boardRevision >= 5 && boardRevision <= 7)
+	{
+		return 0b1101;
+	}
+	return 0;
+}
+
+void applyBoardRevision(CC1200 & radio, int boardRevision, RadioSettings & settings)
+{
+	settings.boardRevision = boardRevision;
 
 	if(boardRevision == 1)
 	{
@@ -243,25 +246,142 @@ void askForRadioSettings(Stream& pc, CC1200 &radio)
 		radio.setOutputPower(14);
 		//radio.setOutputPower(-10);
 		radio.setRSSIOffset(-76); // Calibrated for transponder (no LNA)
-		radio.configurePreamble(0b1011, 0);
-
 	}
 	else if(boardRevision == 5)
 	{
 		radio.setOutputPower(0);
 		radio.setRSSIOffset(-96); // Calibrated for PSA4 LNA
-		radio.configurePreamble(0b1101, 0);
 	}
 	else if(boardRevision == 6)
 	{
 		radio.setOutputPower(-16);
 		radio.setRSSIOffset(-96); // Calibrated for PSA4 LNA
-		radio.configurePreamble(0b1101, 0);
 	}
 	else if(boardRevision == 7)
 	{
 		radio.setOutputPower(-7);
 		radio.setRSSIOffset(-96); // Calibrated for PSA4 LNA
-		radio.configurePreamble(0b1101, 0);
 	}
+
+	uint8_t boardPreambleLengthCfg = getBoardPreambleLengthCfg(boardRevision);
+	if(boardPreambleLengthCfg != 0)
+	{
+		radio.configurePreamble(boardPreambleLengthCfg, 0);
+		settings.preambleLengthCfg = boardPreambleLengthCfg;
+	}
+}
+
+int askForBoardRevision(Stream& pc)
+{
+	int boardRevision=-1;
+	//MENU. ADD AN OPTION FOR EACH TEST.
+	pc.printf("Select board revision: \n");
+	pc.printf("1.  RangefinderTest\n");
+	pc.printf("2.  Ground Station V1 +31.0dBm\n");
+	pc.printf("3.  Ground Station V1 +1.5dBm\n"); // used for receive sensitivity testing
+	pc.printf("4.  Transponder V1 +11.1dBm\n");
+	pc.printf("5.  Ground Station V2 +33dBm\n");
+	pc.printf("6.  Ground Station V2 -0.6 dBm\n");
+	pc.printf("7.  Ground Station V2 +23.5 dBm\n");
+
+	pc.scanf("%d", &boardRevision);
+	pc.printf("Running test with revision  %d:\n\n", boardRevision);
+
+	return boardRevision;
+}
+
+RadioSettings askForRadioSettings(Stream& pc, CC1200 &radio)
+{
+	RadioSettings settings;
+
+	int config=-1;
+	//MENU. ADD AN OPTION FOR EACH TEST.
+	pc.printf("Select a config: \n");
+	pc.printf("1.  38.4ksps 2-GFSK DEV=20kHz CHF=104kHz\n");
+	pc.printf("2.  38.4ksps 2-GFSK DEV=20kHz CHF=104kHz Max-IF\n");
+	pc.printf("3.  38.4ksps 2-GFSK DEV=20kHz CHF=104kHz Zero-IF\n");
+    pc.printf("4.  100ksps 2-GFSK DEV=50kHz CHF=208kHz\n");
+    pc.printf("5.  100ksps 2-GFSK DEV=50kHz CHF=208kHz Max-IF\n");
+    pc.printf("6.  100ksps 2-GFSK DEV=50kHz CHF=208kHz Zero-IF\n");
+    pc.printf("7.  500ksps 2-FSK DEV=125kHz CHF=833kHz\n");
+    pc.printf("8.  500ksps 2-FSK DEV=125kHz CHF=833kHz Max-IF\n");
+    pc.printf("9.  500ksps 2-FSK DEV=399kHz CHF=1666kHz Zero-IF\n");
+	pc.printf("10.  Flight Configuration\n");
+
+	config = 0;
+	pc.scanf("%d", &config);
+	pc.printf("Running test with config %d:\n\n", config);
+
+	if(!applyRadioConfig(radio, config, settings))
+	{
+		pc.printf("Invalid entry.\n");
+	}
+
+	int boardRevision = askForBoardRevision(pc);
+	applyBoardRevision(radio, boardRevision, settings);
+
+	return settings;
+}
+
+RadioSettings loadOrAskForRadioSettings(Stream& pc, CC1200 & radio, ConfigStore & store, size_t radioIndex)
+{
+	RadioSettings settings;
+	if(store.isLoaded() && store.applyRadio(radioIndex, radio, settings))
+	{
+		pc.printf(">> Using saved config %d, board revision %d\n", settings.config, settings.boardRevision);
+		return settings;
+	}
+
+	settings = askForRadioSettings(pc, radio);
+	store.captureRadio(radioIndex, radio, settings);
+	return settings;
+}
+
+void offerToSaveSettings(Stream& pc, ConfigStore & store)
+{
+	if(store.isLoaded())
+	{
+		return;
+	}
+
+	pc.printf("Save these settings for the next boot? 0 = no, 1 = yes\n");
+	int saveEntry = 0;
+	pc.scanf("%d", &saveEntry);
+	if(saveEntry != 1)
+	{
+		return;
+	}
+
+	if(store.save())
+	{
+		pc.printf(">> Settings saved.\n");
+	}
+	else
+	{
+		pc.printf(">> ERROR: Failed to save settings to flash (or the firmware overlaps the config sector)\n");
+	}
+}
+
+int checkForClearCommand(Stream& pc, ConfigStore & store)
+{
+	if(!pc.readable())
+	{
+		return -1;
+	}
+
+	int command = pc.getc();
+	if(command != 'c')
+	{
+		return command;
+	}
+
+	if(store.clear())
+	{
+		pc.printf(">> Saved settings cleared, the next boot will ask for settings again.\n");
+	}
+	else
+	{
+		pc.printf(">> ERROR: Failed to clear saved settings\n");
+	}
+	return command;
 }
@@ -7,6 +7,76 @@
 
 #include <CC1200.h>
 
-void askForRadioSettings(Stream& pc, CC1200 & radio);
+class ConfigStore;
+
+/**
+ * Record of the settings which were applied to a radio.
+ * Tests that change settings afterwards (e.g. the packet mode) should update this to match.
+ */
+struct RadioSettings
+{
+	int config = -1;
+	int boardRevision = -1;
+
+	float symbolRate = 0;
+	CC1200::ModFormat modFormat = CC1200::ModFormat::FSK_2;
+
+	uint8_t preambleLengthCfg = 5; // default chip setting
+	CC1200::SyncMode syncMode = CC1200::SyncMode::SYNC_32_BITS;
+
+	CC1200::PacketMode packetMode = CC1200::PacketMode::VARIABLE_LENGTH;
+	size_t packetLength = 0; // only used in fixed length mode
+	bool crcEnabled = true; // enabled by default on the chip
+};
+
+/**
+ * Apply one of the numbered radio configurations from the menu.
+ * @param settings Filled in with the applied settings
+ * @return false if the config number is invalid
+ */
+bool applyRadioConfig(CC1200 & radio, int config, RadioSettings & settings);
+
+/**
+ * Get the preamble length that a board revision needs, since some boards need a longer preamble than the configs use.
+ * @return Preamble length setting, or 0 if the board doesn't override it
+ */
+uint8_t getBoardPreambleLengthCfg(int boardRevision);
+
+/**
+ * Apply the output power, RSSI offset and preamble overrides for one of the numbered board revisions.
+ * Must be called after applyRadioConfig(), since configs overwrite the preamble setting.
+ * @param settings Updated with the applied settings
+ */
+void applyBoardRevision(CC1200 & radio, int boardRevision, RadioSettings & settings);
+
+/**
+ * Ask the user for a board revision over the serial port.
+ * @return The board revision number, to pass to applyBoardRevision()
+ */
+int askForBoardRevision(Stream& pc);
+
+/**
+ * Ask the user for a radio configuration and board revision over the serial port, and apply them to the radio.
+ * @return The settings that were applied
+ */
+RadioSettings askForRadioSettings(Stream& pc, CC1200 & radio);
+
+/**
+ * Apply the settings saved in the config store for this radio if there are any.
+ * Otherwise, ask for them like askForRadioSettings() and capture them into the store, ready for offerToSaveSettings().
+ * @return The settings that were applied
+ */
+RadioSettings loadOrAskForRadioSettings(Stream& pc, CC1200 & radio, ConfigStore & store, size_t radioIndex);
+
+/**
+ * If the settings in the store were entered by hand this boot, ask whether to save them to flash for the next boot.
+ */
+void offerToSaveSettings(Stream& pc, ConfigStore & store);
+
+/**
+ * Clear the saved settings if the user has sent a 'c'.  Doesn't block, so it can be called from a test's main loop.
+ * @return The character received, or -1 if there was none, so the test can handle its own commands too
+ */
+int checkForClearCommand(Stream& pc, ConfigStore & store);
 
 #endif //LIGHTSPEEDRANGEFINDER_RADIOSETTINGSMENU_H
@@ -0,0 +1,273 @@
+//
+// Streaming estimator which turns raw ranging exchanges into a filtered range estimate.
+//
+
+#include "RangeEstimator.h"
+
+#include <algorithm>
+
+namespace
+{
+	/**
+	 * Multiply two Q16 numbers.
+	 */
+	inline int64_t mulQ(int64_t a, int64_t b)
+	{
+		return (a * b) >> RangeKalmanFilter::FRAC_BITS;
+	}
+
+	/**
+	 * Divide two Q16 numbers, giving a Q16 result.  Avoids overflowing the numerator
+	 * by shifting the denominator instead when the numerator is large.
+	 */
+	inline int64_t divQ(int64_t num, int64_t den)
+	{
+		const int64_t maxShiftableNum = INT64_C(1) << (62 - RangeKalmanFilter::FRAC_BITS);
+		if(num < maxShiftableNum && num > -maxShiftableNum)
+		{
+			return (num << RangeKalmanFilter::FRAC_BITS) / den;
+		}
+		return num / std::max<int64_t>(den >> RangeKalmanFilter::FRAC_BITS, 1);
+	}
+
+	/**
+	 * Integer square root, rounded down.
+	 */
+	int64_t isqrt(int64_t value)
+	{
+		if(value <= 0)
+		{
+			return 0;
+		}
+
+		uint64_t remainder = static_cast<uint64_t>(value);
+		uint64_t result = 0;
+		uint64_t bit = UINT64_C(1) << 62;
+		while(bit > remainder)
+		{
+			bit >>= 2;
+		}
+		while(bit != 0)
+		{
+			if(remainder >= result + bit)
+			{
+				remainder -= result + bit;
+				result = (result >> 1) + bit;
+			}
+			else
+			{
+				result >>= 1;
+			}
+			bit >>= 2;
+		}
+		return static_cast<int64_t>(result);
+	}
+
+	// Time gap after which the filter restarts instead of extrapolating
+	const std::chrono::microseconds maxPredictionGap = std::chrono::seconds(2);
+
+	// MAD to standard deviation scale factor for normally distributed data, times 10000
+	const int64_t madToStdDev = 14826;
+
+	// Variance of the median of N samples is approximately pi/2 * sigma^2 / N.  Times 1000.
+	const int64_t medianVarianceFactor = 1571;
+}
+
+RangeKalmanFilter::RangeKalmanFilter(int64_t accelNoise, int64_t initialRateStdDev):
+accelNoise(accelNoise),
+initialRateVariance((initialRateStdDev * initialRateStdDev) << FRAC_BITS)
+{
+}
+
+void RangeKalmanFilter::reset()
+{
+	initialized = false;
+	x0 = 0;
+	x1 = 0;
+	p00 = 0;
+	p01 = 0;
+	p11 = 0;
+}
+
+void RangeKalmanFilter::predict(int64_t dt)
+{
+	// constant velocity model, with white noise acceleration
+	const int64_t dt2 = mulQ(dt, dt);
+	const int64_t dt3 = mulQ(dt2, dt);
+
+	x0 += mulQ(x1, dt);
+
+	p00 += mulQ(dt, 2 * p01) + mulQ(dt, mulQ(dt, p11)) + accelNoise * dt3 / 3;
+	p01 += mulQ(dt, p11) + accelNoise * dt2 / 2;
+	p11 = std::min(p11 + accelNoise * dt, initialRateVariance);
+}
+
+void RangeKalmanFilter::update(int64_t measurement, int64_t variance, std::chrono::microseconds timestamp)
+{
+	const int64_t z = measurement << FRAC_BITS;
+	const int64_t r = std::max<int64_t>(variance, 1) << FRAC_BITS;
+
+	if(!initialized || timestamp - lastTimestamp > maxPredictionGap || timestamp < lastTimestamp)
+	{
+		x0 = z;
+		x1 = 0;
+		p00 = r;
+		p01 = 0;
+		p11 = initialRateVariance;
+		lastTimestamp = timestamp;
+		initialized = true;
+		return;
+	}
+
+	// convert elapsed time to Q16 seconds
+	const int64_t dt = ((timestamp - lastTimestamp).count() << FRAC_BITS) / 1000000;
+	lastTimestamp = timestamp;
+	predict(dt);
+
+	const int64_t innovationVariance = p00 + r;
+	const int64_t k0 = divQ(p00, innovationVariance);
+	const int64_t k1 = divQ(p01, innovationVariance);
+
+	const int64_t innovation = z - x0;
+	x0 += mulQ(k0, innovation);
+	x1 += mulQ(k1, innovation);
+
+	// P = (I - KH)P
+	const int64_t newP00 = p00 - mulQ(k0, p00);
+	const int64_t newP01 = p01 - mulQ(k0, p01);
+	const int64_t newP11 = p11 - mulQ(k1, p01);
+
+	p00 = std::max<int64_t>(newP00, 1);
+	p01 = newP01;
+	p11 = std::max<int64_t>(newP11, 1);
+}
+
+int64_t RangeKalmanFilter::getStdDev() const
+{
+	return isqrt(p00 >> FRAC_BITS);
+}
+
+char const * RangeEstimator::getResultName(RangeEstimator::SampleResult result)
+{
+	switch(result)
+	{
+		case SampleResult::ACCEPTED: return "accepted";
+		case SampleResult::FUSED: return "fused";
+		case SampleResult::NO_TRANSMISSION: return "no transmission";
+		case SampleResult::NO_RESPONSE: return "no response";
+		case SampleResult::OUTLIER: return "outlier";
+		default: return "unknown";
+	}
+}
+
+RangeEstimator::RangeEstimator(size_t fusionLength, int64_t targetPrecision, int64_t madFloor, int64_t outlierThreshold, int64_t accelNoise):
+fusionLength(std::min(std::max<size_t>(fusionLength, 1), MAX_FUSION_LEN)),
+targetPrecision(targetPrecision),
+madFloor(madFloor),
+outlierThreshold(outlierThreshold),
+kalman(accelNoise, 10000)
+{
+}
+
+void RangeEstimator::reset()
+{
+	kalman.reset();
+	windowCount = 0;
+	windowNextIndex = 0;
+	fusionCount = 0;
+	numExchanges = 0;
+	numInvalid = 0;
+	numOutliers = 0;
+	numFused = 0;
+	exchangesToTarget = 0;
+}
+
+RangeEstimator::SampleResult RangeEstimator::addSample(std::chrono::nanoseconds txCapturedTime, std::chrono::nanoseconds rxCapturedTime,
+	bool seenTransmission, bool receivedResponse, std::chrono::microseconds timestamp)
+{
+	++numExchanges;
+
+	// Without both sync edges, the captured times are whatever was left over from before.
+	if(!seenTransmission)
+	{
+		++numInvalid;
+		return SampleResult::NO_TRANSMISSION;
+	}
+	if(!receivedResponse)
+	{
+		++numInvalid;
+		return SampleResult::NO_RESPONSE;
+	}
+
+	const int64_t sample = (rxCapturedTime - txCapturedTime).count();
+
+	// Outliers stay in the window so that a real step change in range becomes the new median
+	// instead of being rejected forever.
+	window[windowNextIndex] = sample;
+	windowNextIndex = (windowNextIndex + 1) % WINDOW_LEN;
+	windowCount = std::min(windowCount + 1, WINDOW_LEN);
+
+	if(windowCount >= MIN_WINDOW_SAMPLES)
+	{
+		std::array<int64_t, WINDOW_LEN> sortedWindow = window;
+		const int64_t windowMedian = median(sortedWindow.data(), windowCount);
+		const int64_t mad = getWindowMAD(windowMedian);
+
+		const int64_t deviation = sample > windowMedian ? sample - windowMedian : windowMedian - sample;
+		if(deviation * 10000 > outlierThreshold * madToStdDev * mad)
+		{
+			++numOutliers;
+			return SampleResult::OUTLIER;
+		}
+	}
+
+	fusionBuffer[fusionCount++] = sample;
+	if(fusionCount < fusionLength)
+	{
+		return SampleResult::ACCEPTED;
+	}
+
+	const int64_t fusedSample = median(fusionBuffer.data(), fusionCount);
+	fusionCount = 0;
+
+	const int64_t sampleStdDev = getSampleStdDev();
+	const int64_t fusedVariance = (sampleStdDev * sampleStdDev * medianVarianceFactor) / (1000 * static_cast<int64_t>(fusionLength));
+	kalman.update(fusedSample, fusedVariance, timestamp);
+	++numFused;
+
+	if(exchangesToTarget == 0 && kalman.getStdDev() <= targetPrecision)
+	{
+		exchangesToTarget = numExchanges;
+	}
+
+	return SampleResult::FUSED;
+}
+
+int64_t RangeEstimator::getSampleStdDev() const
+{
+	if(windowCount == 0)
+	{
+		return (madFloor * madToStdDev) / 10000;
+	}
+
+	std::array<int64_t, WINDOW_LEN> sortedWindow = window;
+	const int64_t windowMedian = median(sortedWindow.data(), windowCount);
+	return (getWindowMAD(windowMedian) * madToStdDev) / 10000;
+}
+
+int64_t RangeEstimator::median(int64_t * values, size_t count)
+{
+	std::nth_element(values, values + count / 2, values + count);
+	return values[count / 2];
+}
+
+int64_t RangeEstimator::getWindowMAD(int64_t windowMedian) const
+{
+	std::array<int64_t, WINDOW_LEN> deviations;
+	for(size_t index = 0; index < windowCount; ++index)
+	{
+		deviations[index] = window[index] > windowMedian ? window[index] - windowMedian : windowMedian - window[index];
+	}
+
+	return std::max(median(deviations.data(), windowCount), madFloor);
+}
@@ -0,0 +1,250 @@
+//
+// Streaming estimator which turns raw ranging exchanges into a filtered range estimate.
+//
+
+#ifndef LIGHTSPEEDRANGEFINDER_RANGEESTIMATOR_H
+#define LIGHTSPEEDRANGEFINDER_RANGEESTIMATOR_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Two-state (round-trip time and round-trip time rate) Kalman filter, implemented in fixed point
+ * so that it runs in constant time without an FPU.
+ *
+ * All state is held as Q16 (16 fractional bits) integers.  Times are in nanoseconds and
+ * rates in nanoseconds per second.
+ */
+class RangeKalmanFilter
+{
+public:
+
+	static constexpr int FRAC_BITS = 16;
+
+	/**
+	 * @param accelNoise Process noise: spectral density of the round-trip time acceleration, in ns^2/s^3.
+	 *    Larger values let the filter follow faster range changes at the cost of more noise.
+	 * @param initialRateStdDev Uncertainty of the rate when the filter is first initialized, in ns/s.
+	 */
+	RangeKalmanFilter(int64_t accelNoise, int64_t initialRateStdDev);
+
+	/**
+	 * Reset the filter to its uninitialized state.  The next measurement will initialize it.
+	 */
+	void reset();
+
+	/**
+	 * Incorporate a new measurement.
+	 * @param measurement Round-trip time in ns
+	 * @param variance Variance of the measurement, in ns^2
+	 * @param timestamp Time that the measurement was taken at
+	 */
+	void update(int64_t measurement, int64_t variance, std::chrono::microseconds timestamp);
+
+	bool isInitialized() const
+	{
+		return initialized;
+	}
+
+	/**
+	 * @return Estimated round-trip time in ns
+	 */
+	int64_t getValue() const
+	{
+		return x0 >> FRAC_BITS;
+	}
+
+	/**
+	 * @return Estimated rate of change of the round-trip time in ns/s
+	 */
+	int64_t getRate() const
+	{
+		return x1 >> FRAC_BITS;
+	}
+
+	/**
+	 * @return Standard deviation of the round-trip time estimate in ns
+	 */
+	int64_t getStdDev() const;
+
+private:
+
+	void predict(int64_t dt);
+
+	int64_t accelNoise;
+	int64_t initialRateVariance;
+
+	bool initialized = false;
+	std::chrono::microseconds lastTimestamp{0};
+
+	// state vector
+	int64_t x0 = 0;
+	int64_t x1 = 0;
+
+	// covariance matrix (symmetric, so P10 == P01)
+	int64_t p00 = 0;
+	int64_t p01 = 0;
+	int64_t p11 = 0;
+};
+
+/**
+ * Estimator pipeline for ranging round-trip times.
+ *
+ * Each raw exchange goes through the following stages:
+ * 1. Validation: exchanges where the ranging timer did not capture both sync edges are dropped.
+ * 2. Outlier rejection: samples further than outlierThreshold standard deviations (estimated using
+ *    the median absolute deviation of the recent samples) from the recent median are rejected.
+ * 3. Fusion: every fusionLength accepted samples are combined into one measurement using their median.
+ * 4. Tracking: fused measurements are fed into a RangeKalmanFilter.
+ *
+ * The estimator keeps track of when the estimate first reached the target precision, which tells us
+ * how many exchanges are needed per range fix.
+ */
+class RangeEstimator
+{
+public:
+
+	/// Max number of samples used for outlier rejection
+	static constexpr size_t WINDOW_LEN = 15;
+
+	/// Max number of samples that can be fused into one measurement
+	static constexpr size_t MAX_FUSION_LEN = 15;
+
+	/// Outlier rejection isn't done until this many samples are in the window
+	static constexpr size_t MIN_WINDOW_SAMPLES = 5;
+
+	enum class SampleResult : uint8_t
+	{
+		ACCEPTED, // Sample was accepted and is waiting to be fused
+		FUSED, // Sample was accepted and completed a fused measurement, so the estimate was updated
+		NO_TRANSMISSION, // Ranging timer never saw the transmission
+		NO_RESPONSE, // Ranging timer never saw the response
+		OUTLIER // Sample was rejected by the MAD filter
+	};
+
+	static char const * getResultName(SampleResult result);
+
+	/**
+	 * @param fusionLength Number of accepted samples to combine into each measurement.  Max MAX_FUSION_LEN.
+	 * @param targetPrecision Standard deviation (in ns) that the estimate must reach to count as a range fix.
+	 * @param madFloor Minimum median absolute deviation (in ns) to use.  Prevents rejecting everything
+	 *    when the samples are quantized to the same value.  Should be about the timer resolution.
+	 * @param outlierThreshold Samples more than this many standard deviations from the median are rejected.
+	 * @param accelNoise Process noise for the Kalman filter, see RangeKalmanFilter.
+	 */
+	RangeEstimator(size_t fusionLength, int64_t targetPrecision, int64_t madFloor = 2, int64_t outlierThreshold = 3, int64_t accelNoise = 500000);
+
+	/**
+	 * Reset the estimator to its initial state.
+	 */
+	void reset();
+
+	/**
+	 * Add a raw ranging exchange to the estimator.
+	 * @param txCapturedTime Captured time of the transmission from the ranging timer
+	 * @param rxCapturedTime Captured time of the response from the ranging timer
+	 * @param seenTransmission Whether the ranging timer saw the transmission
+	 * @param receivedResponse Whether the ranging timer saw the response
+	 * @param timestamp Time that the exchange happened, used for rate tracking
+	 */
+	SampleResult addSample(std::chrono::nanoseconds txCapturedTime, std::chrono::nanoseconds rxCapturedTime,
+		bool seenTransmission, bool receivedResponse, std::chrono::microseconds timestamp);
+
+	/**
+	 * @return Whether at least one fused measurement has been made
+	 */
+	bool hasEstimate() const
+	{
+		return kalman.isInitialized();
+	}
+
+	/**
+	 * @return Estimated round-trip time in ns
+	 */
+	int64_t getRoundTripTime() const
+	{
+		return kalman.getValue();
+	}
+
+	/**
+	 * @return Estimated rate of change of the round-trip time in ns/s
+	 */
+	int64_t getRoundTripRate() const
+	{
+		return kalman.getRate();
+	}
+
+	/**
+	 * @return Standard deviation of the round-trip time estimate in ns
+	 */
+	int64_t getStdDev() const
+	{
+		return kalman.getStdDev();
+	}
+
+	/**
+	 * @return Whether the estimate has reached the target precision.
+	 */
+	bool hasReachedTarget() const
+	{
+		return exchangesToTarget != 0;
+	}
+
+	/**
+	 * @return Number of exchanges (including invalid ones) it took to first reach the target precision,
+	 *    or 0 if it has not been reached.
+	 */
+	size_t getExchangesToTarget() const
+	{
+		return exchangesToTarget;
+	}
+
+	/**
+	 * @return Current robust estimate of the standard deviation of a single sample, in ns.
+	 */
+	int64_t getSampleStdDev() const;
+
+	size_t getNumExchanges() const { return numExchanges; }
+	size_t getNumInvalid() const { return numInvalid; }
+	size_t getNumOutliers() const { return numOutliers; }
+	size_t getNumFused() const { return numFused; }
+
+private:
+
+	/**
+	 * Get the median of the first count elements of an array.  Reorders the array.
+	 */
+	static int64_t median(int64_t * values, size_t count);
+
+	/**
+	 * @return Median absolute deviation of the window, clamped to madFloor.
+	 */
+	int64_t getWindowMAD(int64_t windowMedian) const;
+
+	size_t fusionLength;
+	int64_t targetPrecision;
+	int64_t madFloor;
+	int64_t outlierThreshold;
+
+	RangeKalmanFilter kalman;
+
+	// ring buffer of recent valid samples, used for outlier rejection
+	std::array<int64_t, WINDOW_LEN> window;
+	size_t windowCount = 0;
+	size_t windowNextIndex = 0;
+
+	// accepted samples waiting to be fused
+	std::array<int64_t, MAX_FUSION_LEN> fusionBuffer;
+	size_t fusionCount = 0;
+
+	size_t numExchanges = 0;
+	size_t numInvalid = 0;
+	size_t numOutliers = 0;
+	size_t numFused = 0;
+	size_t exchangesToTarget = 0;
+};
+
+
+#endif //LIGHTSPEEDRANGEFINDER_RANGEESTIMATOR_H
@@ -0,0 +1,44 @@
+//
+// Minimal frame format for ranging exchanges.
+//
+
+#include "RangingFrame.h"
+
+#include <algorithm>
+
+constexpr size_t RangingFrameFormat::PAYLOAD_LEN;
+
+RangingFrameFormat RangingFrameFormat::forConfig(int config)
+{
+	// Starting points, tune these with the TestJitter frame comparison.
+	// The faster configs wait longer for the AGC to settle (AGC_CFG1), so they get more preamble.
+	if(config >= 1 && config <= 6)
+	{
+		// 38.4ksps and 100ksps: 2 bytes of preamble
+		return {4, CC1200::SyncMode::SYNC_16_BITS, 8};
+	}
+	else
+	{
+		// 500ksps: 3 bytes of preamble
+		return {5, CC1200::SyncMode::SYNC_16_BITS, 8};
+	}
+}
+
+void RangingFrameFormat::apply(CC1200 & radio, RadioSettings & settings) const
+{
+	const uint8_t appliedPreambleLengthCfg = std::max(preambleLengthCfg, getBoardPreambleLengthCfg(settings.boardRevision));
+
+	// 16 bit sync words use the low half of the sync word registers
+	radio.configureSyncWord(0x930B51DE, syncMode, syncThreshold);
+	radio.configurePreamble(appliedPreambleLengthCfg, 0);
+
+	radio.setPacketMode(CC1200::PacketMode::FIXED_LENGTH);
+	radio.setPacketLength(PAYLOAD_LEN);
+	radio.setCRCEnabled(false);
+
+	settings.preambleLengthCfg = appliedPreambleLengthCfg;
+	settings.syncMode = syncMode;
+	settings.packetMode = CC1200::PacketMode::FIXED_LENGTH;
+	settings.packetLength = PAYLOAD_LEN;
+	settings.crcEnabled = false;
+}
@@ -0,0 +1,41 @@
+//
+// Minimal frame format for ranging exchanges.
+//
+
+#ifndef LIGHTSPEEDRANGEFINDER_RANGINGFRAME_H
+#define LIGHTSPEEDRANGEFINDER_RANGINGFRAME_H
+
+#include <CC1200.h>
+
+#include "RadioSettingsMenu.h"
+
+/**
+ * Frame format used when the packets are only there to generate sync edges for the ranging timer.
+ *
+ * Only the sync word timing matters for ranging, so the frame is cut down to the shortest preamble
+ * and sync word each profile can still lock on, plus a 1 byte sequence ID in fixed length mode with no CRC.
+ */
+struct RangingFrameFormat
+{
+	uint8_t preambleLengthCfg;
+	CC1200::SyncMode syncMode;
+	uint8_t syncThreshold;
+
+	// Payload is just the sequence ID
+	static constexpr size_t PAYLOAD_LEN = 1;
+
+	/**
+	 * Get the ranging frame format for one of the numbered radio configs.
+	 */
+	static RangingFrameFormat forConfig(int config);
+
+	/**
+	 * Apply this format to a radio which already has its config and board revision applied.
+	 * The board revision's preamble length is kept if it is longer than this format's,
+	 * since those boards need the extra preamble for their amplifiers.
+	 * @param settings Updated with the new frame settings
+	 */
+	void apply(CC1200 & radio, RadioSettings & settings) const;
+};
+
+#endif //LIGHTSPEEDRANGEFINDER_RANGINGFRAME_H
@@ -0,0 +1,292 @@
+//
+// Test program which sweeps the receiver across the 410-480 MHz band and measures the RSSI on each channel,
+// to find quiet channels before a flight.
+//
+// Each channel's frequency synthesizer calibration is measured once and cached, so hopping is just
+// a few burst register writes instead of a full calibration.
+//
+// In streaming mode, each sweep is sent over the serial port as a binary frame (all values little endian):
+//   0xA5 0x5A                   sync
+//   uint8   sequence number
+//   uint32  start frequency, kHz
+//   uint16  channel step, kHz
+//   uint16  number of channels (N)
+//   uint32  sweep time, us
+//   int8[N] RSSI of each channel, dBm
+//   uint16  CRC-16/CCITT of everything between the sync word and the CRC
+//
+
+#include <mbed.h>
+#include <SerialStream.h>
+
+#include <CC1200.h>
+#include <algorithm>
+#include <cinttypes>
+
+#include "../pins.h"
+
+#include "Checksum.h"
+#include "RadioSettingsMenu.h"
+
+BufferedSerial serial(USBTX, USBRX, 115200);
+SerialStream<BufferedSerial> pc(serial);
+
+CC1200 radio(PIN_RADIO_SPI_MOSI, PIN_RADIO_SPI_MISO, PIN_RADIO_SPI_SCLK, PIN_RADIO_CS, PIN_RADIO_RST, &pc);
+CC1200 dummy(PIN_RADIO_SPI_MOSI, PIN_RADIO_SPI_MISO, PIN_RADIO_SPI_SCLK, PIN_RADIO_DUMMY_CS, PIN_RADIO_DUMMY_RST, &pc);
+
+const uint32_t bandStartKHz = 410000;
+const uint32_t bandEndKHz = 480000;
+
+// Smallest step is 100kHz
+const size_t maxChannels = 701;
+
+const float xoscFrequency = 40e6;
+const float loDivider = 8; // for the 410-480MHz band
+
+// Give up waiting for a valid RSSI after this many polls, e.g. if the radio didn't enter RX
+const size_t maxRSSIPolls = 1000;
+
+/**
+ * Cached register values needed to tune to one channel
+ */
+struct ChannelCalibration
+{
+	uint8_t freq[3]; // FREQ2, FREQ1, FREQ0
+	uint8_t fsChp;
+	uint8_t fsVco[3]; // FS_VCO4, FS_VCO3, FS_VCO2, in register order for burst writing
+};
+
+ChannelCalibration calibrations[maxChannels];
+int8_t rssiValues[maxChannels];
+
+uint32_t stepKHz = 1000;
+size_t numChannels = 0;
+uint8_t sweepSequence = 0;
+
+const size_t frameHeaderLen = 15;
+uint8_t frameBuffer[frameHeaderLen + maxChannels + 2];
+
+/**
+ * Fill in the FREQ register values for a frequency.
+ */
+void calculateFreqRegisters(uint32_t frequencyKHz, uint8_t * freq)
+{
+	// RF frequency = FREQ * f_xosc / (LO divider * 2^16)
+	const uint32_t freqWord = static_cast<uint32_t>(frequencyKHz * 1000.0 * loDivider * 65536 / xoscFrequency + 0.5);
+	freq[0] = static_cast<uint8_t>(freqWord >> 16);
+	freq[1] = static_cast<uint8_t>(freqWord >> 8);
+	freq[2] = static_cast<uint8_t>(freqWord);
+}
+
+/**
+ * Run a frequency synthesizer calibration on every channel and save the results.
+ */
+void calibrateChannels()
+{
+	pc.printf(">> Calibrating %zu channels...\n", numChannels);
+
+	Timer calTimer;
+	calTimer.start();
+
+	for(size_t channel = 0; channel < numChannels; ++channel)
+	{
+		ChannelCalibration & cal = calibrations[channel];
+		calculateFreqRegisters(bandStartKHz + channel * stepKHz, cal.freq);
+
+		radio.writeRegisters(CC1200::ExtRegister::FREQ2, cal.freq, 3);
+		radio.sendCommand(CC1200::Command::CAL_FREQ_SYNTH);
+		wait_us(100);
+		do
+		{
+			radio.updateState();
+		}
+		while(radio.getState() == CC1200::State::CALIBRATE || radio.getState() == CC1200::State::SETTLING);
+
+		cal.fsChp = radio.readRegister(CC1200::ExtRegister::FS_CHP);
+		cal.fsVco[0] = radio.readRegister(CC1200::ExtRegister::FS_VCO4);
+		cal.fsVco[1] = radio.readRegister(CC1200::ExtRegister::FS_VCO3);
+		cal.fsVco[2] = radio.readRegister(CC1200::ExtRegister::FS_VCO2);
+	}
+
+	pc.printf(">> Calibration took %" PRIi64 "ms\n", static_cast<int64_t>(chrono::duration_cast<chrono::milliseconds>(calTimer.elapsed_time()).count()));
+}
+
+void configureRFSettings()
+{
+	askForRadioSettings(pc, radio);
+
+	pc.printf("Enter channel step in kHz (at least 100): \n");
+	int enteredStep = -1;
+	pc.scanf("%d", &enteredStep);
+	if(enteredStep < 100)
+	{
+		pc.printf("Invalid entry, using 1000kHz.\n");
+		enteredStep = 1000;
+	}
+	stepKHz = static_cast<uint32_t>(enteredStep);
+	numChannels = (bandEndKHz - bandStartKHz) / stepKHz + 1;
+
+	// The synthesizer must not recalibrate itself when going to RX, that would overwrite the cached calibration
+	// and take much longer than the hop.  SETTLING_CFG.FS_AUTOCAL = never.
+	uint8_t settlingCfg = radio.readRegister(CC1200::Register::SETTLING_CFG);
+	radio.writeRegister(CC1200::Register::SETTLING_CFG, settlingCfg & ~0x18);
+
+	// Don't let packets in the noise fill up the RX FIFO
+	radio.setOnReceiveState(CC1200::State::IDLE, CC1200::State::IDLE);
+
+	calibrateChannels();
+}
+
+/**
+ * Measure the RSSI on every channel.
+ * @return Time the sweep took
+ */
+std::chrono::microseconds sweep()
+{
+	Timer sweepTimer;
+	sweepTimer.start();
+
+	for(size_t channel = 0; channel < numChannels; ++channel)
+	{
+		ChannelCalibration const & cal = calibrations[channel];
+
+		// Retune: FREQ2-FREQ0 and FS_VCO4-FS_VCO2 are each contiguous, so this is 3 SPI transactions
+		radio.writeRegisters(CC1200::ExtRegister::FREQ2, cal.freq, 3);
+		radio.writeRegister(CC1200::ExtRegister::FS_CHP, cal.fsChp);
+		radio.writeRegisters(CC1200::ExtRegister::FS_VCO4, cal.fsVco, 3);
+
+		radio.sendCommand(CC1200::Command::RX);
+
+		// RSSI0.RSSI_VALID goes high once the AGC has settled
+		size_t polls = 0;
+		while(!(radio.readRegister(CC1200::ExtRegister::RSSI0) & 0x1) && polls < maxRSSIPolls)
+		{
+			++polls;
+		}
+
+		float rssi = polls < maxRSSIPolls ? radio.getRSSIRegister() : -128;
+		rssiValues[channel] = static_cast<int8_t>(std::max(-128.0f, std::min(127.0f, rssi)));
+
+		radio.sendCommand(CC1200::Command::IDLE);
+	}
+
+	radio.sendCommand(CC1200::Command::FLUSH_RX);
+
+	return sweepTimer.elapsed_time();
+}
+
+/**
+ * Append a little endian value to the frame.
+ */
+template<typename T>
+size_t putLE(uint8_t * buffer, size_t offset, T value)
+{
+	for(size_t byte = 0; byte < sizeof(T); ++byte)
+	{
+		buffer[offset + byte] = static_cast<uint8_t>(static_cast<uint32_t>(value) >> (8 * byte));
+	}
+	return offset + sizeof(T);
+}
+
+/**
+ * Send the last sweep as a binary frame.
+ */
+void sendSweepFrame(std::chrono::microseconds sweepTime)
+{
+	size_t offset = 0;
+	frameBuffer[offset++] = 0xA5;
+	frameBuffer[offset++] = 0x5A;
+	frameBuffer[offset++] = sweepSequence++;
+	offset = putLE<uint32_t>(frameBuffer, offset, bandStartKHz);
+	offset = putLE<uint16_t>(frameBuffer, offset, static_cast<uint16_t>(stepKHz));
+	offset = putLE<uint16_t>(frameBuffer, offset, static_cast<uint16_t>(numChannels));
+	offset = putLE<uint32_t>(frameBuffer, offset, static_cast<uint32_t>(sweepTime.count()));
+
+	for(size_t channel = 0; channel < numChannels; ++channel)
+	{
+		frameBuffer[offset++] = static_cast<uint8_t>(rssiValues[channel]);
+	}
+
+	uint16_t crc = crc16CCITT(frameBuffer + 2, offset - 2);
+	offset = putLE<uint16_t>(frameBuffer, offset, crc);
+
+	serial.write(frameBuffer, offset);
+}
+
+/**
+ * Do one sweep and print it as text.
+ */
+void printSweep()
+{
+	std::chrono::microseconds sweepTime = sweep();
+
+	size_t quietestChannel = 0;
+	for(size_t channel = 0; channel < numChannels; ++channel)
+	{
+		pc.printf("%7.03f MHz: %4" PRIi8 " dBm\n", (bandStartKHz + channel * stepKHz) / 1000.0f, rssiValues[channel]);
+		if(rssiValues[channel] < rssiValues[quietestChannel])
+		{
+			quietestChannel = channel;
+		}
+	}
+
+	pc.printf(">> Swept %zu channels in %" PRIi64 "us (%" PRIi64 "us per channel)\n", numChannels,
+		static_cast<int64_t>(sweepTime.count()), static_cast<int64_t>(sweepTime.count() / numChannels));
+	pc.printf(">> Quietest channel: %.03f MHz at %" PRIi8 " dBm\n", (bandStartKHz + quietestChannel * stepKHz) / 1000.0f, rssiValues[quietestChannel]);
+}
+
+/**
+ * Send binary sweep frames until a key is pressed.
+ */
+void streamSweeps()
+{
+	pc.printf(">> Streaming sweep frames, press any key to stop.\n");
+	ThisThread::sleep_for(100ms); // let the message go out before binary data starts
+
+	while(!serial.readable())
+	{
+		sendSweepFrame(sweep());
+	}
+
+	char key;
+	serial.read(&key, 1);
+	pc.printf("\n>> Stopped streaming.\n");
+}
+
+int main()
+{
+	pc.printf("\nSpectrum Scan Test Suite:\n");
+
+	pc.printf(">> Configuring radio...\n");
+	if(!radio.begin())
+	{
+		pc.printf("ERROR: Failed to connect to CC1200\n");
+		while(true){}
+	}
+
+	configureRFSettings();
+
+	while(1){
+		int test=-1;
+		//MENU. ADD AN OPTION FOR EACH TEST.
+		pc.printf("Select a test: \n");
+		pc.printf("1.  Exit Test Suite\n");
+		pc.printf("2.  Single sweep (text)\n");
+		pc.printf("3.  Stream sweeps (binary frames)\n");
+		pc.printf("4.  Recalibrate channels\n");
+
+		pc.scanf("%d", &test);
+		printf("Running test %d:\n\n", test);
+		//SWITCH. ADD A CASE FOR EACH TEST.
+		switch(test) {
+			case 1:         pc.printf("Exiting test suite.\n");    return 0;
+			case 2:         printSweep();              break;
+			case 3:         streamSweeps();              break;
+			case 4:         calibrateChannels();              break;
+			default:        pc.printf("Invalid test number. Please run again.\n"); continue;
+		}
+		pc.printf("done.\r\n");
+	}
+
+	return 0;
+}
@@ -0,0 +1,323 @@
+//
+// Forward error correction for the infinite length streaming tests.
+//
+
+#include "StreamFEC.h"
+
+#include <algorithm>
+
+namespace
+{
+	/**
+	 * Log and antilog tables for GF(256) with primitive polynomial x^8 + x^4 + x^3 + x^2 + 1,
+	 * plus the RS generator polynomial.  Built at compile time.
+	 */
+	struct GaloisTables
+	{
+		// exp is doubled up so that the sum of two logs can be looked up without a modulo
+		uint8_t exp[512];
+		uint8_t log[256];
+
+		// generator polynomial coefficients, indexed by power of x
+		uint8_t generator[ReedSolomon::PARITY_LEN + 1];
+
+		constexpr GaloisTables():
+		exp(),
+		log(),
+		generator()
+		{
+			unsigned int value = 1;
+			for(size_t power = 0; power < 255; ++power)
+			{
+				exp[power] = static_cast<uint8_t>(value);
+				exp[power + 255] = static_cast<uint8_t>(value);
+				log[value] = static_cast<uint8_t>(power);
+
+				value <<= 1;
+				if(value & 0x100)
+				{
+					value ^= 0x11D;
+				}
+			}
+			exp[510] = exp[0];
+			exp[511] = exp[1];
+
+			// generator = (x + a^0)(x + a^1)...(x + a^(PARITY_LEN - 1))
+			generator[0] = 1;
+			for(size_t root = 0; root < ReedSolomon::PARITY_LEN; ++root)
+			{
+				for(size_t power = root + 1; power > 0; --power)
+				{
+					generator[power] = generator[power - 1] ^ mul(generator[power], exp[root]);
+				}
+				generator[0] = mul(generator[0], exp[root]);
+			}
+		}
+
+		constexpr uint8_t mul(uint8_t a, uint8_t b) const
+		{
+			return (a == 0 || b == 0) ? 0 : exp[log[a] + log[b]];
+		}
+
+		constexpr uint8_t div(uint8_t a, uint8_t b) const
+		{
+			return a == 0 ? 0 : exp[log[a] + 255 - log[b]];
+		}
+
+		/**
+		 * @return a^power, for any power
+		 */
+		constexpr uint8_t pow(size_t power) const
+		{
+			return exp[power % 255];
+		}
+	};
+
+	constexpr GaloisTables gf;
+}
+
+constexpr size_t ReedSolomon::CODEWORD_LEN;
+constexpr size_t ReedSolomon::PARITY_LEN;
+constexpr size_t ReedSolomon::DATA_LEN;
+constexpr size_t ReedSolomon::MAX_CORRECTABLE;
+
+void ReedSolomon::encode(uint8_t const * data, uint8_t * parity)
+{
+	// Division by the generator polynomial using a shift register.  parity[0] holds the highest power.
+	std::fill(parity, parity + PARITY_LEN, 0);
+
+	for(size_t dataIndex = 0; dataIndex < DATA_LEN; ++dataIndex)
+	{
+		const uint8_t feedback = data[dataIndex] ^ parity[0];
+
+		std::copy(parity + 1, parity + PARITY_LEN, parity);
+		parity[PARITY_LEN - 1] = 0;
+
+		if(feedback != 0)
+		{
+			const uint8_t feedbackLog = gf.log[feedback];
+			for(size_t parityIndex = 0; parityIndex < PARITY_LEN; ++parityIndex)
+			{
+				const uint8_t genCoef = gf.generator[PARITY_LEN - 1 - parityIndex];
+				if(genCoef != 0)
+				{
+					parity[parityIndex] ^= gf.exp[feedbackLog + gf.log[genCoef]];
+				}
+			}
+		}
+	}
+}
+
+int ReedSolomon::decode(uint8_t * codeword)
+{
+	// Codeword byte i is the coefficient of x^(CODEWORD_LEN - 1 - i).
+
+	// Syndromes: evaluate the received polynomial at each root of the generator
+	uint8_t syndromes[PARITY_LEN];
+	bool hasErrors = false;
+	for(size_t root = 0; root < PARITY_LEN; ++root)
+	{
+		uint8_t syndrome = 0;
+		for(size_t index = 0; index < CODEWORD_LEN; ++index)
+		{
+			syndrome = (syndrome == 0 ? 0 : gf.exp[gf.log[syndrome] + root]) ^ codeword[index];
+		}
+		syndromes[root] = syndrome;
+		hasErrors |= syndrome != 0;
+	}
+
+	if(!hasErrors)
+	{
+		return 0;
+	}
+
+	// Berlekamp-Massey: find the error locator polynomial
+	uint8_t locator[PARITY_LEN + 1] = {1};
+	uint8_t prevLocator[PARITY_LEN + 1] = {1};
+	size_t numErrors = 0;
+	size_t shift = 1;
+	uint8_t prevDiscrepancy = 1;
+
+	for(size_t step = 0; step < PARITY_LEN; ++step)
+	{
+		uint8_t discrepancy = syndromes[step];
+		for(size_t index = 1; index <= numErrors; ++index)
+		{
+			discrepancy ^= gf.mul(locator[index], syndromes[step - index]);
+		}
+
+		if(discrepancy == 0)
+		{
+			++shift;
+			continue;
+		}
+
+		uint8_t oldLocator[PARITY_LEN + 1];
+		std::copy(locator, locator + PARITY_LEN + 1, oldLocator);
+
+		const uint8_t scale = gf.div(discrepancy, prevDiscrepancy);
+		for(size_t index = 0; index + shift <= PARITY_LEN; ++index)
+		{
+			locator[index + shift] ^= gf.mul(scale, prevLocator[index]);
+		}
+
+		if(2 * numErrors <= step)
+		{
+			numErrors = step + 1 - numErrors;
+			std::copy(oldLocator, oldLocator + PARITY_LEN + 1, prevLocator);
+			prevDiscrepancy = discrepancy;
+			shift = 1;
+		}
+		else
+		{
+			++shift;
+		}
+	}
+
+	if(numErrors > MAX_CORRECTABLE)
+	{
+		return -1;
+	}
+
+	// Chien search: error locations are where the locator has roots.
+	// Only positions inside the shortened codeword are checked, roots anywhere else mean it's uncorrectable.
+	size_t errorPositions[MAX_CORRECTABLE];
+	size_t numRoots = 0;
+	for(size_t position = 0; position < CODEWORD_LEN; ++position)
+	{
+		const size_t inversePower = 255 - (CODEWORD_LEN - 1 - position);
+
+		uint8_t sum = 0;
+		for(size_t index = 0; index <= numErrors; ++index)
+		{
+			if(locator[index] != 0)
+			{
+				sum ^= gf.pow(gf.log[locator[index]] + index * inversePower);
+			}
+		}
+
+		if(sum == 0)
+		{
+			if(numRoots == numErrors)
+			{
+				return -1;
+			}
+			errorPositions[numRoots++] = position;
+		}
+	}
+
+	if(numRoots != numErrors)
+	{
+		return -1;
+	}
+
+	// Error evaluator polynomial: syndromes * locator mod x^PARITY_LEN
+	uint8_t evaluator[PARITY_LEN] = {};
+	for(size_t power = 0; power < PARITY_LEN; ++power)
+	{
+		for(size_t index = 0; index <= std::min(power, numErrors); ++index)
+		{
+			evaluator[power] ^= gf.mul(syndromes[power - index], locator[index]);
+		}
+	}
+
+	// Forney algorithm: error value = X * evaluator(X^-1) / locator'(X^-1)
+	for(size_t errorIndex = 0; errorIndex < numErrors; ++errorIndex)
+	{
+		const size_t position = errorPositions[errorIndex];
+		const size_t locationPower = CODEWORD_LEN - 1 - position;
+		const size_t inversePower = 255 - locationPower;
+
+		uint8_t numerator = 0;
+		for(size_t power = 0; power < PARITY_LEN; ++power)
+		{
+			if(evaluator[power] != 0)
+			{
+				numerator ^= gf.pow(gf.log[evaluator[power]] + power * inversePower);
+			}
+		}
+
+		// formal derivative only keeps the odd powers
+		uint8_t denominator = 0;
+		for(size_t power = 1; power <= numErrors; power += 2)
+		{
+			if(locator[power] != 0)
+			{
+				denominator ^= gf.pow(gf.log[locator[power]] + (power - 1) * inversePower);
+			}
+		}
+
+		if(denominator == 0)
+		{
+			return -1;
+		}
+
+		codeword[position] ^= gf.mul(gf.pow(locationPower), gf.div(numerator, denominator));
+	}
+
+	return static_cast<int>(numErrors);
+}
+
+constexpr size_t StreamFEC::INTERLEAVE_DEPTH;
+constexpr size_t StreamFEC::BLOCK_LEN;
+constexpr size_t StreamFEC::PAYLOAD_LEN;
+
+void StreamFEC::encodeBlock(uint8_t const * payload, uint8_t * block)
+{
+	for(size_t codewordIndex = 0; codewordIndex < INTERLEAVE_DEPTH; ++codewordIndex)
+	{
+		uint8_t const * data = payload + codewordIndex * ReedSolomon::DATA_LEN;
+
+		uint8_t parity[ReedSolomon::PARITY_LEN];
+		ReedSolomon::encode(data, parity);
+
+		for(size_t index = 0; index < ReedSolomon::DATA_LEN; ++index)
+		{
+			block[index * INTERLEAVE_DEPTH + codewordIndex] = data[index];
+		}
+		for(size_t index = 0; index < ReedSolomon::PARITY_LEN; ++index)
+		{
+			block[(ReedSolomon::DATA_LEN + index) * INTERLEAVE_DEPTH + codewordIndex] = parity[index];
+		}
+	}
+}
+
+bool StreamFEC::decodeBlock(uint8_t const * block, uint8_t * payload)
+{
+	bool success = true;
+
+	for(size_t codewordIndex = 0; codewordIndex < INTERLEAVE_DEPTH; ++codewordIndex)
+	{
+		uint8_t codeword[ReedSolomon::CODEWORD_LEN];
+		for(size_t index = 0; index < ReedSolomon::CODEWORD_LEN; ++index)
+		{
+			codeword[index] = block[index * INTERLEAVE_DEPTH + codewordIndex];
+		}
+
+		int numCorrected = ReedSolomon::decode(codeword);
+		if(numCorrected < 0)
+		{
+			success = false;
+		}
+		else
+		{
+			correctedBytes += numCorrected;
+		}
+
+		std::copy(codeword, codeword + ReedSolomon::DATA_LEN, payload + codewordIndex * ReedSolomon::DATA_LEN);
+	}
+
+	++numBlocks;
+	if(!success)
+	{
+		++failedBlocks;
+	}
+	return success;
+}
+
+void StreamFEC::resetStats()
+{
+	numBlocks = 0;
+	correctedBytes = 0;
+	failedBlocks = 0;
+}
@@ -0,0 +1,93 @@
+//
+// Forward error correction for the infinite length streaming tests.
+//
+
+#ifndef LIGHTSPEEDRANGEFINDER_STREAMFEC_H
+#define LIGHTSPEEDRANGEFINDER_STREAMFEC_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Reed-Solomon error correction code over GF(256), shortened to RS(32, 24).
+ * Each codeword carries 24 data bytes and 8 parity bytes, and can correct up to 4 byte errors.
+ *
+ * All Galois field arithmetic goes through log/antilog tables which are generated at compile time,
+ * so the tables live in flash.
+ */
+class ReedSolomon
+{
+public:
+	static constexpr size_t CODEWORD_LEN = 32;
+	static constexpr size_t PARITY_LEN = 8;
+	static constexpr size_t DATA_LEN = CODEWORD_LEN - PARITY_LEN;
+
+	/// Max number of byte errors that can be corrected per codeword
+	static constexpr size_t MAX_CORRECTABLE = PARITY_LEN / 2;
+
+	/**
+	 * Compute the parity bytes for a codeword.
+	 * @param data DATA_LEN bytes of data
+	 * @param parity Output, PARITY_LEN bytes
+	 */
+	static void encode(uint8_t const * data, uint8_t * parity);
+
+	/**
+	 * Correct errors in a codeword in place.
+	 * @param codeword CODEWORD_LEN bytes: data followed by parity.
+	 * @return Number of bytes corrected, or -1 if there were too many errors to correct.
+	 */
+	static int decode(uint8_t * codeword);
+};
+
+/**
+ * FEC layer applied to stream payloads.
+ *
+ * Each block is one TX FIFO's worth (128 bytes) of stream data, made of INTERLEAVE_DEPTH interleaved RS(32, 24)
+ * codewords.  Byte i of a block belongs to codeword (i % INTERLEAVE_DEPTH), so a burst of up to
+ * INTERLEAVE_DEPTH * 4 = 16 consecutive bad bytes can still be corrected.
+ */
+class StreamFEC
+{
+public:
+	static constexpr size_t INTERLEAVE_DEPTH = 4;
+
+	/// Size of an encoded block on the air
+	static constexpr size_t BLOCK_LEN = ReedSolomon::CODEWORD_LEN * INTERLEAVE_DEPTH;
+
+	/// Size of the payload carried by each block
+	static constexpr size_t PAYLOAD_LEN = ReedSolomon::DATA_LEN * INTERLEAVE_DEPTH;
+
+	/**
+	 * Encode and interleave a block.
+	 * @param payload PAYLOAD_LEN bytes of payload
+	 * @param block Output, BLOCK_LEN bytes to be sent
+	 */
+	static void encodeBlock(uint8_t const * payload, uint8_t * block);
+
+	/**
+	 * De-interleave and decode a block, and add the result to the statistics.
+	 * @param block BLOCK_LEN bytes that were received
+	 * @param payload Output, PAYLOAD_LEN bytes.  Filled in even if the block couldn't be fully corrected.
+	 * @return true if every codeword in the block was decoded successfully
+	 */
+	bool decodeBlock(uint8_t const * block, uint8_t * payload);
+
+	void resetStats();
+
+	/// Number of blocks decoded since the stats were reset
+	size_t getNumBlocks() const { return numBlocks; }
+
+	/// Number of bytes corrected since the stats were reset
+	size_t getCorrectedBytes() const { return correctedBytes; }
+
+	/// Number of blocks which had at least one uncorrectable codeword since the stats were reset
+	size_t getFailedBlocks() const { return failedBlocks; }
+
+private:
+	size_t numBlocks = 0;
+	size_t correctedBytes = 0;
+	size_t failedBlocks = 0;
+};
+
+#endif //LIGHTSPEEDRANGEFINDER_STREAMFEC_H
@@ -1,5 +1,6 @@
 //
 // Test program receives a stream of data using infinite length mode, matching the rangefinder's RF settings.
+// The RSSI, LQI and data quality of every chunk are kept in a history which can be exported by sending 'e'.
 //
 
 #include <mbed.h>
@@ -7,11 +8,18 @@
 
 #include <CC1200.h>
 #include <cinttypes>
+#include <cmath>
 
 #include "../MovingAverage.h"
 #include "../pins.h"
 
+#include "ConfigStore.h"
+#include "LinkAdaptation.h"
+#include "LinkTiming.h"
+#include "MemoryBudget.h"
 #include "RadioSettingsMenu.h"
+#include "StreamFEC.h"
+#include "TimeSeriesStore.h"
 
 UnbufferedSerial serial(USBTX, USBRX, 115200);
 SerialStream<UnbufferedSerial> pc(serial);
@@ -19,15 +27,89 @@ SerialStream<UnbufferedSerial> pc(serial);
 CC1200 radio(PIN_RADIO_SPI_MOSI, PIN_RADIO_SPI_MISO, PIN_RADIO_SPI_SCLK, PIN_RADIO_CS, PIN_RADIO_RST, &pc);
 CC1200 dummy(PIN_RADIO_SPI_MOSI, PIN_RADIO_SPI_MISO, PIN_RADIO_SPI_SCLK, PIN_RADIO_DUMMY_CS, PIN_RADIO_DUMMY_RST, &pc);
 
-void configureRFSettings()
-{
-	askForRadioSettings(pc, radio);
+const size_t bufferLen = 128; // Size of TX FIFO
+
+// Holds the test buffers, so the build fails if they get too big for the RAM budget
+StaticArena<MemoryBudget::bytesFor<char>(bufferLen) + MemoryBudget::bytesFor<uint8_t>(StreamFEC::PAYLOAD_LEN)> testArena("StreamingRXTest");
+char * const rxBuffer = testArena.allocate<char>(bufferLen);
+
+// Timeout for receiving one buffer of data, derived from the radio settings
+std::chrono::microseconds chunkTimeout;
+
+RadioSettings radioSettings;
+
+// Link adaptation: step between radio profiles based on the link quality.  Must match the transmitter.
+bool linkAdaptationEnabled = false;
+LinkAdapter linkAdapter;
+LinkControlChannel controlChannel(radio);
+
+// Forward error correction on the stream data.  Must match the transmitter.
+bool fecEnabled = false;
+
+// Settings saved from a previous boot
+ConfigStore configStore;
+
+// When adapting, the transmitter may have moved to a different profile, so don't wait forever for it.
+const auto syncTimeout = 2s;
 
+void configureStreamingMode()
+{
 	// Specific to this test suite: enable infinite length mode
 	radio.setPacketMode(CC1200::PacketMode::INFINITE_LENGTH, false);
+	radioSettings.packetMode = CC1200::PacketMode::INFINITE_LENGTH;
+
+	chunkTimeout = LinkTiming::getTimeout(LinkTiming(radioSettings).getDataTime(bufferLen));
+	pc.printf(">> Timeout for each %zu byte chunk: %" PRIi64 " us\n", bufferLen, static_cast<int64_t>(chunkTimeout.count()));
+}
+
+/**
+ * Switch to a different radio config, keeping the same board revision.
+ */
+void applyProfile(int config)
+{
+	pc.printf(">> Link adaptation: switching to config %d\n", config);
+
+	// applyRadioConfig() resets the settings, so save the revision first
+	const int boardRevision = radioSettings.boardRevision;
+	applyRadioConfig(radio, config, radioSettings);
+	applyBoardRevision(radio, boardRevision, radioSettings);
+}
+
+void configureRFSettings()
+{
+	radioSettings = loadOrAskForRadioSettings(pc, radio, configStore, 0);
+
+	if(configStore.isLoaded())
+	{
+		linkAdaptationEnabled = configStore.getTestFlags() & ConfigStore::FLAG_LINK_ADAPTATION;
+		fecEnabled = configStore.getTestFlags() & ConfigStore::FLAG_FEC;
+		pc.printf(">> Link adaptation %s, FEC %s.  Send 'c' to clear the saved settings.\n",
+			linkAdaptationEnabled ? "on" : "off", fecEnabled ? "on" : "off");
+	}
+	else
+	{
+		pc.printf("Enable link adaptation (must match transmitter)? 0 = no, 1 = yes\n");
+		int adaptationEntry = 0;
+		pc.scanf("%d", &adaptationEntry);
+		linkAdaptationEnabled = adaptationEntry == 1;
+
+		pc.printf("Enable FEC (must match transmitter)? 0 = no, 1 = yes\n");
+		int fecEntry = 0;
+		pc.scanf("%d", &fecEntry);
+		fecEnabled = fecEntry == 1;
+
+		configStore.setTestFlags((linkAdaptationEnabled ? ConfigStore::FLAG_LINK_ADAPTATION : 0) | (fecEnabled ? ConfigStore::FLAG_FEC : 0));
+		offerToSaveSettings(pc, configStore);
+	}
+
+	if(linkAdaptationEnabled && !linkAdapter.setConfig(radioSettings.config))
+	{
+		pc.printf(">> Config %d is not one of the link adaptation profiles.\n", radioSettings.config);
+		applyProfile(linkAdapter.getConfig());
+	}
+
+	configureStreamingMode();
 }
-const size_t bufferLen = 128; // Size of TX FIFO
-char rxBuffer[bufferLen];
 
 const size_t transmissionLen = bufferLen*10;
 
@@ -36,11 +118,123 @@ MovingAverage<float, 100> rssiAverage; // Received Signal Strength Indicator
 MovingAverage<float, 100> lqiAverage; // Link Quality Indicator
 MovingAverage<float, 10> berAverage; // Byte Error Rate
 
+// History of the link over the whole test, one sample per chunk: RSSI (dBm), LQI, correct bytes in the chunk.
+// Keeps 256ms at 1ms resolution, 30s at 100ms and 1 hour at 10s, in about 18kB.
+TimeSeriesStore<int16_t, 3, 256, 300, 360> linkHistory;
+BudgetedGlobal linkHistoryBudget("linkHistory", sizeof(linkHistory));
+Timer testTimer;
+
+/**
+ * Read the radio's RSSI and LQI after a chunk, and record them in the link history.
+ * @param chunkGoodBytes Number of correct bytes in the chunk
+ * @param averaged Whether to include them in the averages used for link adaptation, which only look at chunks received OK
+ */
+void monitorSignal(size_t chunkGoodBytes, bool averaged)
+{
+	const float rssi = radio.getRSSIRegister();
+	const uint8_t lqi = radio.getLQIRegister();
+
+	if(averaged)
+	{
+		rssiAverage << rssi;
+		lqiAverage << lqi;
+	}
+
+	linkHistory.append(chrono::duration_cast<chrono::milliseconds>(testTimer.elapsed_time()),
+		{static_cast<int16_t>(lround(rssi)), static_cast<int16_t>(lqi), static_cast<int16_t>(chunkGoodBytes)});
+}
+
+/**
+ * Send each tier of the link history as a binary frame.
+ */
+void exportLinkHistory()
+{
+	pc.printf(">> Exporting link history\n");
+	for(size_t tier = 0; tier < linkHistory.NUM_TIERS; ++tier)
+	{
+		linkHistory.exportTier(tier, [](uint8_t const * data, size_t len)
+		{
+			serial.write(data, len);
+		});
+	}
+	pc.printf("\n>> Export done.\n");
+}
+
+// FEC: each chunk is one FEC block
+StreamFEC fec;
+uint8_t * const fecPayload = testArena.allocate<uint8_t>(StreamFEC::PAYLOAD_LEN);
+static_assert(StreamFEC::BLOCK_LEN == bufferLen, "FEC blocks must be one chunk long");
+
+// Give up on the stream after this many uncorrectable blocks in a row
+const size_t maxConsecutiveFailedBlocks = 4;
+
+/**
+ * Receive FEC blocks until the end of the transmission.  Blocks that can't be corrected are
+ * counted, but only end the stream if too many fail in a row.
+ * @param successfulBytes Incremented for each correct payload byte
+ * @return true if the end of the transmission was received
+ */
+bool receiveFECStream(size_t & successfulBytes)
+{
+	fec.resetStats();
+
+	size_t consecutiveFailedBlocks = 0;
+	while(true)
+	{
+		bool rxSuccessful = radio.readStreamBlocking(rxBuffer, bufferLen, chunkTimeout);
+
+		// Check for errors
+		if(radio.getState() != CC1200::State::RX)
+		{
+			pc.printf("ERROR: Radio went to invalid state %" PRIu8 ".\n", static_cast<uint8_t>(radio.getState()));
+			return false;
+		}
+
+		if(!rxSuccessful)
+		{
+			pc.printf("ERROR: Timeout receiving bytes from transmitter.\n");
+			monitorSignal(0, false);
+			return false;
+		}
+
+		bool decoded = fec.decodeBlock(reinterpret_cast<uint8_t const *>(rxBuffer), fecPayload);
+		consecutiveFailedBlocks = decoded ? 0 : consecutiveFailedBlocks + 1;
+
+		if(decoded && fecPayload[0] == 0xDD)
+		{
+			// End of transmission
+			return true;
+		}
+
+		// check data.  Payloads always start with 0xAA since their length is even.
+		size_t blockGoodBytes = 0;
+		for(size_t index = 0; index < StreamFEC::PAYLOAD_LEN; ++index)
+		{
+			if(fecPayload[index] == (index % 2 == 0 ? 0xAA : 0xBB))
+			{
+				blockGoodBytes++;
+			}
+		}
+		successfulBytes += blockGoodBytes;
+
+		if(consecutiveFailedBlocks >= maxConsecutiveFailedBlocks)
+		{
+			pc.printf("ERROR: %zu uncorrectable blocks in a row.\n", consecutiveFailedBlocks);
+			monitorSignal(blockGoodBytes, false);
+			return false;
+		}
+
+		// monitor the radio's RSSI
+		monitorSignal(blockGoodBytes, true);
+	}
+}
+
 /**
  * Try to start receiving the data stream.  May fail due to stream not present,
  *
+ * @return true if the stream was received all the way to the end without errors
  */
-void tryReceiveStream()
+bool tryReceiveStream()
 {
 	pc.printf(">> Trying to key in to data stream\n");
 
@@ -48,7 +242,7 @@ void tryReceiveStream()
 	if(radio.getState() != CC1200::State::IDLE)
 	{
 		pc.printf("ERROR: Radio not in IDLE state. Actually in %" PRIu8 "\n", static_cast<uint8_t>(radio.getState()));
-		return;
+		return false;
 	}
 
 	// First, enable RX mode and see if we get any data.
@@ -57,84 +251,106 @@ void tryReceiveStream()
 	lqiAverage.clear();
 
 	// Wait for sync detect
+	Timer syncTimer;
+	syncTimer.start();
 	while(!radio.hasReceivedPacket())
 	{
-
+		if(linkAdaptationEnabled && syncTimer.elapsed_time() > syncTimeout)
+		{
+			pc.printf("ERROR: Timeout waiting for sync.\n");
+			return false;
+		}
 	}
 
-	// Figure out where we are in the data stream
-	uint8_t lastByte;
-	radio.readStream(reinterpret_cast<char *>(&lastByte), 1);
+	size_t successfulBytes = 0;
+	bool streamComplete = false;
 
-	if(lastByte == 0xAA || lastByte == 0xBB)
+	if(fecEnabled)
 	{
-		// OK
+		// With FEC, blocks start right after the sync word, so there's no need to find our place in the stream.
+		streamComplete = receiveFECStream(successfulBytes);
 	}
 	else
 	{
-		pc.printf("ERROR: Received invalid data byte 0x%" PRIx8 ".\n", lastByte);
-		berAverage << 0;
-		return;
-	}
+		// Figure out where we are in the data stream
+		uint8_t lastByte;
+		radio.readStream(reinterpret_cast<char *>(&lastByte), 1);
 
-	// Data looks OK, start receiving
-	size_t successfulBytes = 0;
-	auto timeout = 30ms; // Should take ~2ms to receive 128 bytes, so allow double that
-	while(true)
-	{
-		bool rxSuccessful = radio.readStreamBlocking(rxBuffer, bufferLen, timeout);
-
-		// Check for errors
-		if(radio.getState() != CC1200::State::RX)
+		if(lastByte == 0xAA || lastByte == 0xBB)
 		{
-			pc.printf("ERROR: Radio went to invalid state %" PRIu8 ".\n", static_cast<uint8_t>(radio.getState()));
-			break;
+			// OK
 		}
-
-		if(!rxSuccessful)
+		else
 		{
-			pc.printf("ERROR: Timeout receiving bytes from transmitter.\n");
-			break;
+			pc.printf("ERROR: Received invalid data byte 0x%" PRIx8 ".\n", lastByte);
+			berAverage << 0;
+			return false;
 		}
 
-		// check data
-		bool dataError = false;
-		bool endOfTransmission = false;
-		for(size_t index = 0; index < bufferLen; ++index)
+		// Data looks OK, start receiving
+		while(true)
 		{
-			if(lastByte == 0xAA && rxBuffer[index] == 0xBB)
+			bool rxSuccessful = radio.readStreamBlocking(rxBuffer, bufferLen, chunkTimeout);
+
+			// Check for errors
+			if(radio.getState() != CC1200::State::RX)
 			{
-				// OK
-				successfulBytes++;
+				pc.printf("ERROR: Radio went to invalid state %" PRIu8 ".\n", static_cast<uint8_t>(radio.getState()));
+				break;
 			}
-			else if(lastByte == 0xBB && rxBuffer[index] == 0xAA)
+
+			if(!rxSuccessful)
 			{
-				// OK
-				successfulBytes++;
+				pc.printf("ERROR: Timeout receiving bytes from transmitter.\n");
+				monitorSignal(0, false);
+				break;
 			}
-			else if(rxBuffer[index] == 0xDD)
+
+			// check data
+			const size_t chunkStartBytes = successfulBytes;
+			bool dataError = false;
+			bool endOfTransmission = false;
+			for(size_t index = 0; index < bufferLen; ++index)
 			{
-				// End of transmission
-				endOfTransmission = true;
-				break;
+				if(lastByte == 0xAA && rxBuffer[index] == 0xBB)
+				{
+					// OK
+					successfulBytes++;
+				}
+				else if(lastByte == 0xBB && rxBuffer[index] == 0xAA)
+				{
+					// OK
+					successfulBytes++;
+				}
+				else if(rxBuffer[index] == 0xDD)
+				{
+					// End of transmission
+					endOfTransmission = true;
+					break;
+				}
+				else
+				{
+					pc.printf("ERROR: Received invalid data byte 0x%" PRIx8 ", last byte was 0x%" PRIx8 ".\n", rxBuffer[index], lastByte);
+					dataError = true;
+					break;
+				}
+				lastByte = rxBuffer[index];
 			}
-			else
+
+			if(dataError)
 			{
-				pc.printf("ERROR: Received invalid data byte 0x%" PRIx8 ", last byte was 0x%" PRIx8 ".\n", rxBuffer[index], lastByte);
-				dataError = true;
+				monitorSignal(successfulBytes - chunkStartBytes, false);
+			}
+
+			if(endOfTransmission || dataError)
+			{
+				streamComplete = endOfTransmission;
 				break;
 			}
-			lastByte = rxBuffer[index];
-		}
 
-		if(endOfTransmission || dataError)
-		{
-			break;
+			// monitor the radio's RSSI
+			monitorSignal(successfulBytes - chunkStartBytes, true);
 		}
-
-		// monitor the radio's RSSI
-		rssiAverage << radio.getRSSIRegister();
-		lqiAverage << radio.getLQIRegister();
 	}
 
 	/*pc.printf("Last chunk was:");
@@ -147,6 +363,44 @@ void tryReceiveStream()
 	berAverage << successfulBytes;
 
 	pc.printf("%zu bytes were successfully received, average RSSI %.02f, average LQI %.02f, average BER %.00f.\n", successfulBytes, rssiAverage.getAvg(), lqiAverage.getAvg(), berAverage.getAvg());
+	if(fecEnabled)
+	{
+		pc.printf("FEC: %zu blocks received, %zu bytes corrected, %zu blocks uncorrectable.\n", fec.getNumBlocks(), fec.getCorrectedBytes(), fec.getFailedBlocks());
+	}
+
+	return streamComplete;
+}
+
+/**
+ * Pick the profile for the next stream and agree on it with the transmitter.
+ * Radio must be in IDLE.
+ */
+void adaptLink(bool streamSuccessful)
+{
+	int nextConfig = linkAdapter.getNextConfig(streamSuccessful, rssiAverage.getAvg(), lqiAverage.getAvg());
+
+	bool acknowledged = controlChannel.requestConfig(nextConfig, radioSettings);
+	if(acknowledged)
+	{
+		linkAdapter.setConfig(nextConfig);
+	}
+	else
+	{
+		pc.printf("ERROR: Transmitter did not acknowledge config %d.\n", nextConfig);
+	}
+
+	if(linkAdapter.recordControlExchange(acknowledged))
+	{
+		pc.printf(">> Link adaptation: lost contact with transmitter, falling back.\n");
+	}
+
+	if(linkAdapter.getConfig() != radioSettings.config)
+	{
+		applyProfile(linkAdapter.getConfig());
+	}
+
+	// control channel leaves the radio in packet mode
+	configureStreamingMode();
 }
 
 int main()
@@ -158,13 +412,18 @@ int main()
 		while(true){}
 	}
 
+	configStore.load();
 	configureRFSettings();
 
-	pc.printf(">> Starting receive...\n");
+	// Tests shouldn't need the heap from here on
+	MemoryBudget::lockHeap();
+
+	pc.printf(">> Starting receive.  Send 'e' to export the link history, 'm' for a memory report.\n");
+	testTimer.start();
 
 	while(true)
 	{
-		tryReceiveStream();
+		bool streamSuccessful = tryReceiveStream();
 
 		// If attempt fails, we can try again.
 
@@ -174,6 +433,23 @@ int main()
 
 		// Now go to idle and give the user time to read the message.
 		radio.sendCommand(CC1200::Command::IDLE);
+
+		if(linkAdaptationEnabled)
+		{
+			// The transmitter listens for us right after the stream, so don't delay.
+			adaptLink(streamSuccessful);
+		}
+
+		int command = checkForClearCommand(pc, configStore);
+		if(command == 'e')
+		{
+			exportLinkHistory();
+		}
+		else if(command == 'm')
+		{
+			MemoryBudget::printReport(pc, "StreamingRXTest");
+		}
+
 		ThisThread::sleep_for(100ms);
 	}
 
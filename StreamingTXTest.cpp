@@ -9,7 +9,11 @@
 #include <cinttypes>
 
 #include "../pins.h"
+#include "ConfigStore.h"
+#include "LinkAdaptation.h"
+#include "MemoryBudget.h"
 #include "RadioSettingsMenu.h"
+#include "StreamFEC.h"
 
 
 BufferedSerial serial(USBTX, USBRX, 115200);
@@ -18,19 +22,106 @@ SerialStream<BufferedSerial> pc(serial);
 CC1200 radio(PIN_RADIO_SPI_MOSI, PIN_RADIO_SPI_MISO, PIN_RADIO_SPI_SCLK, PIN_RADIO_CS, PIN_RADIO_RST, &pc);
 CC1200 dummy(PIN_RADIO_SPI_MOSI, PIN_RADIO_SPI_MISO, PIN_RADIO_SPI_SCLK, PIN_RADIO_DUMMY_CS, PIN_RADIO_DUMMY_RST, &pc);
 
-void configureRFSettings()
-{
-	askForRadioSettings(pc, radio);
+RadioSettings radioSettings;
+
+// Link adaptation: step between radio profiles as requested by the receiver.  Must match the receiver.
+bool linkAdaptationEnabled = false;
+LinkAdapter linkAdapter;
+LinkControlChannel controlChannel(radio);
+
+// Forward error correction on the stream data.  Must match the receiver.
+bool fecEnabled = false;
+
+// Settings saved from a previous boot
+ConfigStore configStore;
 
+// Time to let the amp cool down between transmissions
+const auto cooldownTime = 1s;
+
+void configureStreamingMode()
+{
 	// Specific to this test suite: enable infinite length mode
 	radio.setPacketMode(CC1200::PacketMode::INFINITE_LENGTH, false);
+	radioSettings.packetMode = CC1200::PacketMode::INFINITE_LENGTH;
+}
+
+/**
+ * Switch to a different radio config, keeping the same board revision.
+ */
+void applyProfile(int config)
+{
+	pc.printf(">> Link adaptation: switching to config %d\n", config);
+
+	// applyRadioConfig() resets the settings, so save the revision first
+	const int boardRevision = radioSettings.boardRevision;
+	applyRadioConfig(radio, config, radioSettings);
+	applyBoardRevision(radio, boardRevision, radioSettings);
+}
+
+void configureRFSettings()
+{
+	radioSettings = loadOrAskForRadioSettings(pc, radio, configStore, 0);
+
+	if(configStore.isLoaded())
+	{
+		linkAdaptationEnabled = configStore.getTestFlags() & ConfigStore::FLAG_LINK_ADAPTATION;
+		fecEnabled = configStore.getTestFlags() & ConfigStore::FLAG_FEC;
+		pc.printf(">> Link adaptation %s, FEC %s.  Send 'c' to clear the saved settings.\n",
+			linkAdaptationEnabled ? "on" : "off", fecEnabled ? "on" : "off");
+	}
+	else
+	{
+		pc.printf("Enable link adaptation (must match receiver)? 0 = no, 1 = yes\n");
+		int adaptationEntry = 0;
+		pc.scanf("%d", &adaptationEntry);
+		linkAdaptationEnabled = adaptationEntry == 1;
+
+		pc.printf("Enable FEC (must match receiver)? 0 = no, 1 = yes\n");
+		int fecEntry = 0;
+		pc.scanf("%d", &fecEntry);
+		fecEnabled = fecEntry == 1;
+
+		configStore.setTestFlags((linkAdaptationEnabled ? ConfigStore::FLAG_LINK_ADAPTATION : 0) | (fecEnabled ? ConfigStore::FLAG_FEC : 0));
+		offerToSaveSettings(pc, configStore);
+	}
+
+	if(linkAdaptationEnabled && !linkAdapter.setConfig(radioSettings.config))
+	{
+		pc.printf(">> Config %d is not one of the link adaptation profiles.\n", radioSettings.config);
+		applyProfile(linkAdapter.getConfig());
+	}
+
+	configureStreamingMode();
 }
 
 const size_t dataLen = 128; // Size of TX FIFO
-char testData[dataLen];
+
+// Holds the test buffers, so the build fails if they get too big for the RAM budget
+StaticArena<MemoryBudget::bytesFor<char>(dataLen) + MemoryBudget::bytesFor<char>(StreamFEC::BLOCK_LEN)> testArena("StreamingTXTest");
+char * const testData = testArena.allocate<char>(dataLen);
+
+// FEC: each chunk is encoded as one FEC block, carrying StreamFEC::PAYLOAD_LEN bytes of test data
+char * const fecBlock = testArena.allocate<char>(StreamFEC::BLOCK_LEN);
+static_assert(StreamFEC::BLOCK_LEN == dataLen, "FEC blocks must be one chunk long");
 
 const size_t transmissionLen = dataLen*10;
 
+/**
+ * Get the next chunk of data to send, encoding it if FEC is enabled.
+ * @return Pointer to dataLen bytes
+ */
+char const * nextChunk()
+{
+	if(!fecEnabled)
+	{
+		return testData;
+	}
+
+	// Encode every chunk rather than caching it, to make sure the encoder keeps up with the stream.
+	StreamFEC::encodeBlock(reinterpret_cast<uint8_t const *>(testData), reinterpret_cast<uint8_t *>(fecBlock));
+	return fecBlock;
+}
+
 /**
  * Transmit data for a while, then shut down.
  */
@@ -39,7 +130,7 @@ void transmitStream()
 	pc.printf(">> Starting transmission...\n");
 
 	// fill buffer with initial data
-	size_t lengthWritten = radio.writeStream(testData, dataLen);
+	size_t lengthWritten = radio.writeStream(nextChunk(), dataLen);
 	if(lengthWritten != dataLen)
 	{
 		pc.printf("Error: FIFO didn't fill all the way, only wrote %zu bytes\n", lengthWritten);
@@ -66,7 +157,7 @@ void transmitStream()
 	timeoutTimer.start();
 	while(true)
 	{
-		bool txSuccessful = radio.writeStreamBlocking(testData, dataLen);
+		bool txSuccessful = radio.writeStreamBlocking(nextChunk(), dataLen);
 		if(txSuccessful)
 		{
 			successfulBytes += dataLen;
@@ -80,8 +171,18 @@ void transmitStream()
 		if(successfulBytes >= transmissionLen)
 		{
 			// Signal end of transmission
-			char endByte = 0xDD;
-			radio.writeStreamBlocking(&endByte, 1);
+			if(fecEnabled)
+			{
+				uint8_t endPayload[StreamFEC::PAYLOAD_LEN];
+				std::fill(std::begin(endPayload), std::end(endPayload), 0xDD);
+				StreamFEC::encodeBlock(endPayload, reinterpret_cast<uint8_t *>(fecBlock));
+				radio.writeStreamBlocking(fecBlock, StreamFEC::BLOCK_LEN);
+			}
+			else
+			{
+				char endByte = 0xDD;
+				radio.writeStreamBlocking(&endByte, 1);
+			}
 			break;
 		}
 	}
@@ -90,6 +191,44 @@ void transmitStream()
 
 }
 
+/**
+ * Listen for the receiver's profile request while the amp cools down, then switch to that profile.
+ */
+void adaptLink()
+{
+	Timer cooldownTimer;
+	cooldownTimer.start();
+
+	// let the end of the stream go out before leaving TX mode
+	while(radio.getTXFIFOLen() > 0 && cooldownTimer.elapsed_time() < cooldownTime)
+	{}
+	radio.sendCommand(CC1200::Command::IDLE);
+	radio.sendCommand(CC1200::Command::FLUSH_TX);
+
+	int requestedConfig = controlChannel.waitForRequest(radioSettings, std::chrono::duration_cast<std::chrono::microseconds>(cooldownTime - cooldownTimer.elapsed_time()));
+	if(requestedConfig >= 0)
+	{
+		linkAdapter.setConfig(requestedConfig);
+	}
+	else
+	{
+		pc.printf(">> ERROR: No config request from receiver.\n");
+	}
+
+	if(linkAdapter.recordControlExchange(requestedConfig >= 0))
+	{
+		pc.printf(">> Link adaptation: lost contact with receiver, falling back.\n");
+	}
+
+	if(linkAdapter.getConfig() != radioSettings.config)
+	{
+		applyProfile(linkAdapter.getConfig());
+	}
+
+	// control channel leaves the radio in packet mode
+	configureStreamingMode();
+}
+
 int main()
 {
 	pc.printf(">> Configuring radio...\n");
@@ -99,6 +238,7 @@ int main()
 		while(true){}
 	}
 
+	configStore.load();
 	configureRFSettings();
 
 	// Generate data buffer to send.
@@ -108,12 +248,24 @@ int main()
 		testData[index] = (index % 2 == 0 ? 0xAA : 0xBB);
 	}
 
+	// Tests shouldn't need the heap from here on
+	MemoryBudget::lockHeap();
+	pc.printf(">> Send 'm' for a memory report.\n");
+
 	while (true)
 	{
 		transmitStream();
 
-		// wait 1s for amp to cool down
-		ThisThread::sleep_for(1s);
+		if(linkAdaptationEnabled)
+		{
+			// talk to the receiver while the amp cools down
+			adaptLink();
+		}
+		else
+		{
+			// wait 1s for amp to cool down
+			ThisThread::sleep_for(cooldownTime);
+		}
 
 		// If all else fails, try hitting it!
 		// Ensure TX buffer is clear.
@@ -121,6 +273,11 @@ int main()
 
 		// Now go to idle and give the user time to read the message.
 		radio.sendCommand(CC1200::Command::IDLE);
+
+		if(checkForClearCommand(pc, configStore) == 'm')
+		{
+			MemoryBudget::printReport(pc, "StreamingTXTest");
+		}
 	}
 
 }
\ No newline at end of file
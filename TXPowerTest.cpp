@@ -1,5 +1,6 @@
 //
-// Test program that streams data using infinite length mode, matching the rangefinder's RF settings.
+// Test program that keys the transmitter on and off for measuring output power, duty cycle and Morse beacons.
+// The on/off schedule is compiled into an OOK waveform and streamed out, so the radio does the timing.
 //
 
 #include <mbed.h>
@@ -9,8 +10,9 @@
 #include <cinttypes>
 
 #include "../pins.h"
-#include <CC1200Morse.h>
 
+#include "ConfigStore.h"
+#include "OOKWaveform.h"
 #include "RadioSettingsMenu.h"
 
 
@@ -20,29 +22,47 @@ SerialStream<BufferedSerial> pc(serial);
 CC1200 radio(PIN_RADIO_SPI_MOSI, PIN_RADIO_SPI_MISO, PIN_RADIO_SPI_SCLK, PIN_RADIO_CS, PIN_RADIO_RST, &pc);
 CC1200 dummy(PIN_RADIO_SPI_MOSI, PIN_RADIO_SPI_MISO, PIN_RADIO_SPI_SCLK, PIN_RADIO_DUMMY_CS, PIN_RADIO_DUMMY_RST, &pc);
 
+// Settings saved from a previous boot
+ConfigStore configStore;
+
+// 1ms timing resolution
+OOKWaveform waveform(1000);
+
 const auto onTime = 1s;
 const auto offTime = 4s;
+const size_t numDutyCycles = 6;
 
-void configureRFSettings()
-{
-	askForRadioSettings(pc, radio);
+const char morseMessage[] = "TEST TEST DE USCRPL";
+const auto morseDotTime = 60ms; // 20 WPM
 
-	radio.setPacketMode(CC1200::PacketMode::FIXED_LENGTH);
-	radio.setCRCEnabled(false);
+const float powerSteps[] = {-16, -10, -4, 2, 8, 14};
+const auto powerStepTime = 500ms;
 
-	// set frequency
-	radio.setSymbolRate(8.0f / chrono::duration_cast<chrono::duration<float>>(onTime).count());
+void configureRFSettings()
+{
+	loadOrAskForRadioSettings(pc, radio, configStore, 0);
+	waveform.configureRadio(radio);
+}
 
-	// disable anything getting sent before the data
-	radio.configureSyncWord(0x0, CC1200::SyncMode::SYNC_NONE, 8);
-	radio.configurePreamble(0, 0);
+void buildDutyCycle()
+{
+	waveform.addDutyCycle(onTime + offTime, onTime, numDutyCycles);
+}
 
-	// configure OOK modulation
-	radio.setModulationFormat(CC1200::ModFormat::ASK);
-	radio.disablePARamping();
+void buildMorseBeacon()
+{
+	waveform.addMorse(morseMessage, morseDotTime);
+	waveform.addOff(7 * morseDotTime);
+}
 
-	// 1 byte packet
-	radio.setPacketLength(1);
+void buildPowerSteps()
+{
+	for(float outputPower : powerSteps)
+	{
+		waveform.addPowerStep(outputPower);
+		waveform.addOn(powerStepTime);
+		waveform.addOff(powerStepTime);
+	}
 }
 
 int main()
@@ -54,27 +74,49 @@ int main()
 		while(true){}
 	}
 
+	configStore.load();
 	configureRFSettings();
 
-	while (true)
+	int pattern=-1;
+	if(configStore.isLoaded())
 	{
-		char data = 0xFF;
-		radio.enqueuePacket(&data, 1);
-		radio.startTX();
-
-		while(radio.getTXFIFOLen() > 0)
-		{
-			pc.printf("TX radio: state = 0x%" PRIx8 ", TX FIFO len = %zu, FS lock = 0x%u\n",
-					  static_cast<uint8_t>(radio.getState()), radio.getTXFIFOLen(), radio.readRegister(CC1200::ExtRegister::FSCAL_CTRL) & 1);
+		pattern = configStore.getTestSelection();
+		pc.printf(">> Using saved pattern %d.  Send 'c' to clear the saved settings.\n", pattern);
+	}
+	else
+	{
+		pc.printf("Select a pattern: \n");
+		pc.printf("1.  Duty cycle (%" PRIi64 "ms on, %" PRIi64 "ms off)\n",
+			static_cast<int64_t>(chrono::milliseconds(onTime).count()), static_cast<int64_t>(chrono::milliseconds(offTime).count()));
+		pc.printf("2.  Morse beacon\n");
+		pc.printf("3.  Power steps\n");
+		pc.scanf("%d", &pattern);
+
+		configStore.setTestSelection(pattern);
+		offerToSaveSettings(pc, configStore);
+	}
 
-			//ThisThread::sleep_for(5ms);
-		}
+	switch(pattern) {
+		case 1:         buildDutyCycle();         break;
+		case 2:         buildMorseBeacon();       break;
+		case 3:         buildPowerSteps();        break;
+		default:
+			pc.printf("Invalid pattern, using duty cycle.\n");
+			buildDutyCycle();
+			break;
+	}
 
-		ThisThread::sleep_for(onTime);
+	pc.printf(">> Waveform is %zu bytes, %" PRIi64 "ms long\n", waveform.getNumBytes(),
+		static_cast<int64_t>(chrono::duration_cast<chrono::milliseconds>(waveform.getDuration()).count()));
 
-		radio.idle();
+	while (true)
+	{
+		if(!waveform.transmit(radio))
+		{
+			pc.printf(">> ERROR: Radio entered state %" PRIu8 "\n", static_cast<uint8_t>(radio.getState()));
+		}
 
-		ThisThread::sleep_for(offTime);
+		checkForClearCommand(pc, configStore);
 	}
 
-}
\ No newline at end of file
+}
@@ -7,12 +7,20 @@
 
 #include <CC1200.h>
 #include <cinttypes>
+#include <cmath>
 
 #include "../QuickStats.h"
 #include "../RangingTimer.h"
 #include "../pins.h"
 
+#include "ClockDrift.h"
+#include "ConfigStore.h"
+#include "LinkTiming.h"
+#include "MemoryBudget.h"
 #include "RadioSettingsMenu.h"
+#include "RangeEstimator.h"
+#include "RangingFrame.h"
+#include "Transponder.h"
 
 BufferedSerial serial(USBTX, USBRX, 115200);
 SerialStream<BufferedSerial> pc(serial);
@@ -54,31 +62,75 @@ void checkExistance()
 }
 
 const size_t numTrials = 300;
-std::array<int64_t, numTrials> roundtripTimes; //time in ns for each trial
 
-void checkSignalTransmit()
-{
-	pc.printf("Initializing CC1200s.....\n");
-	txRadio.begin();
-	rxRadio.begin();
-	rangingTimer.begin();
+// Longest message received during the ranging trials, plus a null terminator
+const size_t packetBufferLen = 16;
 
-	pc.printf("Configuring RF settings.....\n");
+// Holds the test buffers, so the build fails if they get too big for the RAM budget
+StaticArena<MemoryBudget::bytesFor<std::array<int64_t, numTrials>>() + MemoryBudget::bytesFor<char>(packetBufferLen)> testArena("TestJitter");
+std::array<int64_t, numTrials> & roundtripTimes = *testArena.allocate<std::array<int64_t, numTrials>>(); //time in ns for each trial
+char * const packetBuffer = testArena.allocate<char>(packetBufferLen);
 
-	askForRadioSettings(pc, rxRadio);
-	askForRadioSettings(pc, txRadio);
+// Number of exchanges fused into each range measurement
+const size_t fusionLength = 5;
 
-	// The RX radio will act as the "ground station" radio.  It will transmit a message,
-	// then wait for a response.  The processor, using the radio's sync outputs, records the timestamp
-	// of both events and turns that into the ranging time.
+// Precision (std deviation of the round-trip time, in ns) that counts as a range fix
+const int64_t targetPrecision = 10;
 
-	// The TX radio will act as the "transponder" radio.  It will initially in receive mode, with a packet queued.
-	// Then, when it receives a message, it will automatically switch to TX mode and send its current buffer.
+RangeEstimator rangeEstimator(fusionLength, targetPrecision);
 
-	// rename for less confusion
-	CC1200 & groundStation = std::ref(rxRadio);
-	CC1200 & transponder = std::ref(txRadio);
+// Transponder clock drift, measured on every response and corrected for before the range estimator.
+// Assumes the MCU timer is as accurate as the ground station radio's crystal, see ClockDriftEstimator.
+ClockDriftEstimator clockDrift;
+
+// Mean turnaround (transponder RX sync to TX sync) from the last turnaround measurement, or -1 if not measured yet
+int64_t measuredTurnaround = -1;
+
+// Settings saved from a previous boot.  Radio 0 is the ground station, radio 1 is the transponder.
+ConfigStore configStore;
 
+/**
+ * Print a packet received during the ranging trials.
+ * @param minimalFrame Whether the packet is a minimal ranging frame holding a sequence ID, or a text message
+ */
+void printReceivedPacket(char const * packetBuffer, bool minimalFrame, char expectedSequenceID)
+{
+	if(minimalFrame)
+	{
+		pc.printf(">>RECEIVED: sequence %" PRIu8 "%s\n", static_cast<uint8_t>(packetBuffer[0]),
+			packetBuffer[0] == expectedSequenceID ? "" : " (WRONG SEQUENCE)");
+	}
+	else
+	{
+		pc.printf(">>RECEIVED: %s\n", packetBuffer);
+	}
+}
+
+/**
+ * Summary of one run of ranging trials
+ */
+struct TrialStats
+{
+	size_t packetsReceived;
+	size_t validExchanges; // exchanges where both sync edges were captured.  The timing stats only cover these.
+	double average;
+	uint64_t jitter;
+	double stdDeviation;
+	int64_t driftCorrection; // correction applied to the last exchange, ns
+};
+
+/**
+ * Set up the radios for ranging exchanges and calibrate them.
+ *
+ * The RX radio will act as the "ground station" radio.  It will transmit a message,
+ * then wait for a response.  The processor, using the radio's sync outputs, records the timestamp
+ * of both events and turns that into the ranging time.
+ *
+ * The TX radio will act as the "transponder" radio.  It will initially in receive mode, with a packet queued.
+ * Then, when it receives a message, it will automatically switch to TX mode and send its current buffer.
+ */
+void configureRangingRadios(CC1200 & groundStation, CC1200 & transponder)
+{
 	// configure on-transmit actions
 	transponder.setOnTransmitState(CC1200::State::RX);
 	transponder.setOnReceiveState(CC1200::State::TX, CC1200::State::RX);
@@ -89,44 +141,111 @@ void checkSignalTransmit()
 	groundStation.configureGPIO(0, CC1200::GPIOMode::PKT_SYNC_RXTX);
 	groundStation.configureGPIO(2, CC1200::GPIOMode::PKT_SYNC_RXTX);
 
-	pc.printf("Starting transmission.....\n");
+	// TEMP: manually calibrate FS
+	groundStation.sendCommand(CC1200::Command::CAL_FREQ_SYNTH);
+	transponder.sendCommand(CC1200::Command::CAL_FREQ_SYNTH);
+	ThisThread::sleep_for(1ms);
+	while(groundStation.getState() == CC1200::State::CALIBRATE || transponder.getState() == CC1200::State::CALIBRATE)
+	{}
+}
 
+/**
+ * Get the part of each exchange which is timed by the transponder's clock: its turnaround, plus the preamble
+ * and sync word of its response.  Uses the measured turnaround if there is one for these frames, otherwise LinkTiming's model.
+ * @param requestLen Length of the ground station's request
+ * @param measuredFrames Whether the exchange uses the same frames as the turnaround measurement
+ */
+std::chrono::nanoseconds getTransponderTime(LinkTiming const & groundStationTiming, size_t requestLen,
+	LinkTiming const & transponderTiming, bool measuredFrames)
+{
+	// The measured turnaround starts at the request's sync word, so it includes the rest of the request,
+	// which is timed by the ground station
+	const std::chrono::nanoseconds requestRemainder = groundStationTiming.getPacketAirtime(requestLen) - groundStationTiming.getOverheadTime();
+	if(measuredFrames && measuredTurnaround > requestRemainder.count())
+	{
+		return std::chrono::nanoseconds(measuredTurnaround) - requestRemainder;
+	}
+
+	return LinkTiming::TURNAROUND_TIME + transponderTiming.getOverheadTime();
+}
+
+/**
+ * Run the ranging exchanges, and feed each one to the range estimator.
+ * Each round-trip time is corrected for the transponder's clock drift (see ClockDriftEstimator).
+ * @param minimalFrame If true, send 1 byte sequence ID frames (see RangingFrameFormat) instead of text messages.
+ *     The radios must already be configured for the frame format.
+ * @param verbose Print the details of every exchange
+ */
+TrialStats runRangingTrials(CC1200 & groundStation, CC1200 & transponder, RadioSettings const & groundStationSettings,
+	RadioSettings const & transponderSettings, bool minimalFrame, bool verbose)
+{
 	const char groundStationMessage[] = "Hello world!";
 	const char transponderMessage[] = "Hi back";
-	char packetBuffer[std::max(sizeof(groundStationMessage), sizeof(transponderMessage)) + 1];
+	static_assert(std::max(sizeof(groundStationMessage), sizeof(transponderMessage)) < packetBufferLen, "Packet buffer too small");
 
 	// make sure there's a null terminator even if data is corrupted
-	packetBuffer[sizeof(packetBuffer) - 1] = '\0';
+	packetBuffer[packetBufferLen - 1] = '\0';
 
-	size_t packetsReceived = 0;
+	const size_t groundStationMessageLen = minimalFrame ? RangingFrameFormat::PAYLOAD_LEN : sizeof(groundStationMessage);
+	const size_t transponderMessageLen = minimalFrame ? RangingFrameFormat::PAYLOAD_LEN : sizeof(transponderMessage);
 
-	// data for calculating jitter
+	// Time out once the exchange has taken well over its expected airtime
+	LinkTiming groundStationTiming(groundStationSettings);
+	LinkTiming transponderTiming(transponderSettings);
+	const auto exchangeTime = groundStationTiming.getExchangeTime(groundStationMessageLen, transponderTiming, transponderMessageLen);
+	const auto responseTimeout = LinkTiming::getTimeout(exchangeTime);
+	pc.printf("Expected exchange time: %" PRIi64 " us, response timeout: %" PRIi64 " us\n",
+		static_cast<int64_t>(exchangeTime.count()), static_cast<int64_t>(responseTimeout.count()));
+
+	// the turnaround is measured with the text messages
+	const auto transponderTime = getTransponderTime(groundStationTiming, groundStationMessageLen, transponderTiming, !minimalFrame);
+	pc.printf("Transponder clocked time per exchange: %" PRIi64 " ns\n", static_cast<int64_t>(transponderTime.count()));
+	int64_t driftCorrection = 0;
+
+	size_t packetsReceived = 0;
+	size_t validExchanges = 0;
 
-	// TEMP: manually calibrate FS
-	groundStation.sendCommand(CC1200::Command::CAL_FREQ_SYNTH);
-	transponder.sendCommand(CC1200::Command::CAL_FREQ_SYNTH);
-	ThisThread::sleep_for(1ms);
-	while(groundStation.getState() == CC1200::State::CALIBRATE || transponder.getState() == CC1200::State::CALIBRATE)
-	{}
 	transponder.startRX();
 
+	rangeEstimator.reset();
+	clockDrift.reset();
+	Timer trialTimer;
+	trialTimer.start();
+
 	for(size_t trialIndex = 0; trialIndex < numTrials; ++trialIndex)
 	{
+		// sequence ID for minimal frames.  The transponder can't echo the ID it receives,
+		// so it queues the one the ground station is about to send.
+		const char sequenceID = static_cast<char>(trialIndex);
+
 		// initial conditions:
 		// - ground station is in TX mode with no data (so it isn't transmitting)
 		// - transponder is in RX mode with a packet queued for as soon as it goes into TX mode
-		transponder.enqueuePacket(transponderMessage, sizeof(transponderMessage));
+		transponder.enqueuePacket(minimalFrame ? &sequenceID : transponderMessage, transponderMessageLen);
 
 		wait_ns(rand() % 5000);
 
 		//pc.printf("Ground station radio: state = 0x%" PRIx8 ", TX FIFO len = %zu, RX FIFO len = 0x%u\n",
 		//		  static_cast<uint8_t>(groundStation.getState()), groundStation.getTXFIFOLen(), groundStation.getRXFIFOLen());
-		pc.printf("\n---------------------------------\n");
+		if(verbose)
+		{
+			pc.printf("\n---------------------------------\n");
+		}
 
 		//pc.printf("Before tx: Ground station radio: state = 0x%" PRIx8 ", TX FIFO len = %zu, RX FIFO len = 0x%u\n",
 		//		  static_cast<uint8_t>(groundStation.getState()), groundStation.getTXFIFOLen(), groundStation.getRXFIFOLen());
 
-		pc.printf("<<SENDING TO TRANSPONDER: %s\n", groundStationMessage);
+		if(verbose)
+		{
+			if(minimalFrame)
+			{
+				pc.printf("<<SENDING TO TRANSPONDER: sequence %" PRIu8 "\n", static_cast<uint8_t>(sequenceID));
+			}
+			else
+			{
+				pc.printf("<<SENDING TO TRANSPONDER: %s\n", groundStationMessage);
+			}
+		}
 		rangingTimer.reset(); // reset timer ensuring rollover won't happen
 		groundStation.startTX();
 
@@ -135,60 +254,391 @@ void checkSignalTransmit()
 			groundStation.updateState();
 		}
 
-		groundStation.enqueuePacket(groundStationMessage, sizeof(groundStationMessage));
+		groundStation.enqueuePacket(minimalFrame ? &sequenceID : groundStationMessage, groundStationMessageLen);
 
 		// wait for message and response to go through
 		Timer responseTimer;
 		responseTimer.start();
 		while(!groundStation.hasReceivedPacket())
 		{
-			if(responseTimer.elapsed_time() > 100ms)
+			if(responseTimer.elapsed_time() > responseTimeout)
 			{
-				pc.printf("Timeout waiting for response\n");
+				if(verbose)
+				{
+					pc.printf("Timeout waiting for response\n");
+				}
 				break;
 			}
 		}
 
-		roundtripTimes[trialIndex] = (rangingTimer.getRxCapturedTime() - rangingTimer.getTxCapturedTime()).count();
+		// The frequency offset of the response gives the transponder's clock drift.  Read it before anything else is received.
+		if(groundStation.hasReceivedPacket())
+		{
+			clockDrift.addMeasurement(ClockDriftEstimator::readFrequencyOffset(groundStation));
+		}
+		driftCorrection = clockDrift.getCorrection(transponderTime);
+
+		const int64_t roundtripTime = (rangingTimer.getRxCapturedTime() - rangingTimer.getTxCapturedTime()).count() + driftCorrection;
+
+		// A timed out exchange leaves a stale or zero capture, which would swamp the stats
+		if(rangingTimer.hasSeenTransmission() && rangingTimer.hasReceivedResponse())
+		{
+			roundtripTimes[validExchanges++] = roundtripTime;
+		}
+
+		// Feed the exchange to the estimator.  It drops the sample if either sync edge is missing.
+		RangeEstimator::SampleResult sampleResult = rangeEstimator.addSample(rangingTimer.getTxCapturedTime(),
+			rangingTimer.getRxCapturedTime() + std::chrono::nanoseconds(driftCorrection),
+			rangingTimer.hasSeenTransmission(), rangingTimer.hasReceivedResponse(), trialTimer.elapsed_time());
 
 
 		// get the results
-		pc.printf("Ground station radio: state = 0x%" PRIx8 ", TX FIFO len = %zu, RX FIFO len = 0x%u\n",
-				  static_cast<uint8_t>(groundStation.getState()), groundStation.getTXFIFOLen(), groundStation.getRXFIFOLen());
+		if(verbose)
+		{
+			pc.printf("Ground station radio: state = 0x%" PRIx8 ", TX FIFO len = %zu, RX FIFO len = 0x%u\n",
+					  static_cast<uint8_t>(groundStation.getState()), groundStation.getTXFIFOLen(), groundStation.getRXFIFOLen());
+		}
 		if(groundStation.hasReceivedPacket())
 		{
 			++packetsReceived;
-			groundStation.receivePacket(packetBuffer, sizeof(packetBuffer));
-			pc.printf(">>RECEIVED: %s\n", packetBuffer);
+			groundStation.receivePacket(packetBuffer, packetBufferLen);
+			if(verbose)
+			{
+				printReceivedPacket(packetBuffer, minimalFrame, sequenceID);
+			}
 		}
-		else
+		else if(verbose)
 		{
 			pc.printf(">>No packet received!\n");
 		}
 
-		pc.printf("Transponder radio: state = 0x%" PRIx8 ", TX FIFO len = %zu, RX FIFO len = 0x%u\n",
-				static_cast<uint8_t>(transponder.getState()), transponder.getTXFIFOLen(), transponder.getRXFIFOLen());
+		if(verbose)
+		{
+			pc.printf("Transponder radio: state = 0x%" PRIx8 ", TX FIFO len = %zu, RX FIFO len = 0x%u\n",
+					static_cast<uint8_t>(transponder.getState()), transponder.getTXFIFOLen(), transponder.getRXFIFOLen());
+		}
 
 		if(transponder.hasReceivedPacket())
 		{
-			transponder.receivePacket(packetBuffer, sizeof(packetBuffer));
-			pc.printf(">>RECEIVED: %s\n", packetBuffer);
+			transponder.receivePacket(packetBuffer, packetBufferLen);
+			if(verbose)
+			{
+				printReceivedPacket(packetBuffer, minimalFrame, sequenceID);
+			}
 		}
-		else
+		else if(verbose)
 		{
 			pc.printf(">>No packet received!\n");
 		}
 
-		pc.printf("Elapsed time was %" PRIi64 " (TX time = %" PRIi64 ", RX time = %" PRIi64 ")\n", roundtripTimes[trialIndex], rangingTimer.getTxCapturedTime().count(), rangingTimer.getRxCapturedTime().count());
+		if(verbose)
+		{
+			pc.printf("Elapsed time was %" PRIi64 " (TX time = %" PRIi64 ", RX time = %" PRIi64 ", drift correction %" PRIi64 " ns at %.03f ppm)\n", roundtripTime,
+				rangingTimer.getTxCapturedTime().count(), rangingTimer.getRxCapturedTime().count(), driftCorrection, clockDrift.getDriftPPM());
+			pc.printf("Estimator: sample %s", RangeEstimator::getResultName(sampleResult));
+			if(rangeEstimator.hasEstimate())
+			{
+				pc.printf(", RTT estimate %" PRIi64 " +- %" PRIi64 " ns, rate %" PRIi64 " ns/s", rangeEstimator.getRoundTripTime(),
+					rangeEstimator.getStdDev(), rangeEstimator.getRoundTripRate());
+			}
+			pc.printf("\n");
+		}
+	}
+
+	TrialStats trialStats = {packetsReceived, validExchanges, 0, 0, 0, driftCorrection};
+	if(validExchanges > 0)
+	{
+		// QuickStats only works on a full array, so work out the stats of the valid exchanges here
+		int64_t minTime = roundtripTimes[0];
+		int64_t maxTime = roundtripTimes[0];
+		double sum = 0;
+		for(size_t index = 0; index < validExchanges; ++index)
+		{
+			minTime = std::min(minTime, roundtripTimes[index]);
+			maxTime = std::max(maxTime, roundtripTimes[index]);
+			sum += roundtripTimes[index];
+		}
+		trialStats.average = sum / validExchanges;
+		trialStats.jitter = static_cast<uint64_t>((maxTime - minTime) / 2);
+
+		double sumSquares = 0;
+		for(size_t index = 0; index < validExchanges; ++index)
+		{
+			const double deviation = roundtripTimes[index] - trialStats.average;
+			sumSquares += deviation * deviation;
+		}
+		trialStats.stdDeviation = std::sqrt(sumSquares / validExchanges);
 	}
+	return trialStats;
+}
 
-	QuickStats<int64_t, numTrials> stats(roundtripTimes);
+void printTrialStats(TrialStats const & trialStats)
+{
+	pc.printf("Packets received %zu (%.00f%%)\n", trialStats.packetsReceived, (trialStats.packetsReceived / static_cast<float>(numTrials)) * 100.0f);
+	pc.printf("Valid exchanges %zu, timing stats are over these only\n", trialStats.validExchanges);
+	pc.printf("Average Round-Trip Time: %.00f ns\n", trialStats.average);
+	pc.printf("Jitter: +-%" PRIu64 " ns\n", trialStats.jitter);
+	pc.printf("Standard Deviation: %.00f ns\n", trialStats.stdDeviation);
+	pc.printf("Clock drift: %.03f ppm (%.03f to %.03f over %zu measurements), last correction %" PRIi64 " ns\n",
+		clockDrift.getDriftPPM(), clockDrift.getMinDriftPPM(), clockDrift.getMaxDriftPPM(), clockDrift.getNumMeasurements(), trialStats.driftCorrection);
+}
+
+void checkSignalTransmit()
+{
+	pc.printf("Initializing CC1200s.....\n");
+	txRadio.begin();
+	rxRadio.begin();
+	rangingTimer.begin();
+
+	pc.printf("Configuring RF settings.....\n");
+
+	RadioSettings groundStationSettings = loadOrAskForRadioSettings(pc, rxRadio, configStore, 0);
+	RadioSettings transponderSettings = loadOrAskForRadioSettings(pc, txRadio, configStore, 1);
+	offerToSaveSettings(pc, configStore);
+
+	// rename for less confusion
+	CC1200 & groundStation = std::ref(rxRadio);
+	CC1200 & transponder = std::ref(txRadio);
+
+	configureRangingRadios(groundStation, transponder);
+
+	pc.printf("Starting transmission.....\n");
+
+	TrialStats trialStats = runRangingTrials(groundStation, transponder, groundStationSettings, transponderSettings, false, true);
+
+	printTrialStats(trialStats);
+
+	pc.printf("Estimator: %zu invalid samples, %zu outliers rejected, %zu fused measurements\n",
+		rangeEstimator.getNumInvalid(), rangeEstimator.getNumOutliers(), rangeEstimator.getNumFused());
+	pc.printf("Estimator: sample std deviation %" PRIi64 " ns, final RTT estimate %" PRIi64 " +- %" PRIi64 " ns\n",
+		rangeEstimator.getSampleStdDev(), rangeEstimator.getRoundTripTime(), rangeEstimator.getStdDev());
+	if(rangeEstimator.hasReachedTarget())
+	{
+		pc.printf("Estimator: reached +-%" PRIi64 " ns after %zu exchanges\n", targetPrecision, rangeEstimator.getExchangesToTarget());
+	}
+	else
+	{
+		pc.printf("Estimator: never reached +-%" PRIi64 " ns\n", targetPrecision);
+	}
+
+}
+
+// Standard deviation increase allowed for the minimal ranging frame before it counts as degrading jitter
+const double maxMinimalFrameJitterIncrease = 1.1;
+
+// This test runs the ranging exchanges with the standard frames, then with the minimal ranging frame,
+// to check that cutting down the preamble and sync word doesn't hurt the jitter.
+void compareRangingFrames()
+{
+	pc.printf("Initializing CC1200s.....\n");
+	txRadio.begin();
+	rxRadio.begin();
+	rangingTimer.begin();
+
+	pc.printf("Configuring RF settings.....\n");
+
+	RadioSettings groundStationSettings = loadOrAskForRadioSettings(pc, rxRadio, configStore, 0);
+	RadioSettings transponderSettings = loadOrAskForRadioSettings(pc, txRadio, configStore, 1);
+	offerToSaveSettings(pc, configStore);
+
+	CC1200 & groundStation = std::ref(rxRadio);
+	CC1200 & transponder = std::ref(txRadio);
 
-	pc.printf("Packets received %zu (%.00f%%)\n", packetsReceived, (packetsReceived / static_cast<float>(numTrials)) * 100.0f);
-	pc.printf("Average Round-Trip Time: %.00f ns\n", stats.average);
+	configureRangingRadios(groundStation, transponder);
+
+	pc.printf("\nStandard frame:\n");
+	TrialStats standardStats = runRangingTrials(groundStation, transponder, groundStationSettings, transponderSettings, false, false);
+	printTrialStats(standardStats);
+
+	RangingFrameFormat::forConfig(groundStationSettings.config).apply(groundStation, groundStationSettings);
+	RangingFrameFormat::forConfig(transponderSettings.config).apply(transponder, transponderSettings);
+
+	pc.printf("\nMinimal ranging frame (%zu preamble bits, %zu sync bits, %zu byte payload, no CRC):\n",
+		LinkTiming(groundStationSettings).getPreambleBits(), LinkTiming(groundStationSettings).getSyncBits(), RangingFrameFormat::PAYLOAD_LEN);
+	TrialStats minimalStats = runRangingTrials(groundStation, transponder, groundStationSettings, transponderSettings, true, false);
+	printTrialStats(minimalStats);
+
+	pc.printf("\n");
+	if(minimalStats.validExchanges == 0 || standardStats.validExchanges == 0)
+	{
+		pc.printf(">> ERROR: No valid exchanges to compare jitter with\n");
+	}
+	else if(minimalStats.stdDeviation <= standardStats.stdDeviation * maxMinimalFrameJitterIncrease)
+	{
+		pc.printf(">> Minimal frame jitter OK: std deviation %.00f ns vs %.00f ns\n", minimalStats.stdDeviation, standardStats.stdDeviation);
+	}
+	else
+	{
+		pc.printf(">> ERROR: Minimal frame degrades jitter: std deviation %.00f ns vs %.00f ns\n", minimalStats.stdDeviation, standardStats.stdDeviation);
+	}
+	if(minimalStats.packetsReceived < standardStats.packetsReceived)
+	{
+		pc.printf(">> ERROR: Minimal frame lost more packets: %zu received vs %zu\n", minimalStats.packetsReceived, standardStats.packetsReceived);
+	}
+	if(minimalStats.validExchanges < standardStats.validExchanges)
+	{
+		pc.printf(">> ERROR: Minimal frame had fewer valid exchanges: %zu vs %zu\n", minimalStats.validExchanges, standardStats.validExchanges);
+	}
+}
+
+const size_t histogramBins = 12;
+
+/**
+ * Print a text histogram of the given times.
+ */
+void printHistogram(int64_t const * times, size_t numTimes, int64_t minTime, int64_t maxTime)
+{
+	size_t binCounts[histogramBins] = {};
+	const int64_t binWidth = std::max<int64_t>(1, (maxTime - minTime) / static_cast<int64_t>(histogramBins) + 1);
+
+	for(size_t index = 0; index < numTimes; ++index)
+	{
+		++binCounts[(times[index] - minTime) / binWidth];
+	}
+
+	for(size_t bin = 0; bin < histogramBins; ++bin)
+	{
+		pc.printf("%8" PRIi64 " ns | %4zu | ", minTime + static_cast<int64_t>(bin) * binWidth, binCounts[bin]);
+
+		// scale so the full run would be 50 characters wide
+		for(size_t mark = 0; mark < (binCounts[bin] * 50 + numTimes - 1) / numTimes; ++mark)
+		{
+			pc.printf("#");
+		}
+		pc.printf("\n");
+	}
+}
+
+/**
+ * Run ranging exchanges where only the transponder drives the sync line, and record its turnaround times.
+ * @param preloaded Use the preloaded transponder instead of writing the response before every exchange
+ */
+void measureTurnaround(CC1200 & groundStation, CC1200 & transponder, RadioSettings const & groundStationSettings,
+	RadioSettings const & transponderSettings, bool preloaded)
+{
+	const char groundStationMessage[] = "Hello world!";
+	const char transponderMessage[] = "Hi back";
+	static_assert(std::max(sizeof(groundStationMessage), sizeof(transponderMessage)) < packetBufferLen, "Packet buffer too small");
+
+	LinkTiming groundStationTiming(groundStationSettings);
+	LinkTiming transponderTiming(transponderSettings);
+	const auto responseTimeout = LinkTiming::getTimeout(groundStationTiming.getExchangeTime(sizeof(groundStationMessage), transponderTiming, sizeof(transponderMessage)));
+
+	PreloadedTransponder preloadedTransponder(transponder);
+	transponder.idle();
+	if(preloaded)
+	{
+		preloadedTransponder.preload(transponderMessage, sizeof(transponderMessage));
+	}
+	else
+	{
+		transponder.sendCommand(CC1200::Command::FLUSH_TX);
+	}
+	transponder.startRX();
+
+	size_t numTurnarounds = 0;
+	size_t numAttempts = 0;
+
+	Timer runTimer;
+	runTimer.start();
+
+	// Keep going until every slot has a valid turnaround so the stats cover real exchanges only
+	while(numTurnarounds < numTrials && numAttempts < 2 * numTrials)
+	{
+		++numAttempts;
+
+		if(!preloaded)
+		{
+			transponder.enqueuePacket(transponderMessage, sizeof(transponderMessage));
+		}
+
+		rangingTimer.reset();
+		groundStation.startTX();
+		while(groundStation.getState() != CC1200::State::TX) {
+			groundStation.updateState();
+		}
+		groundStation.enqueuePacket(groundStationMessage, sizeof(groundStationMessage));
+
+		Timer responseTimer;
+		responseTimer.start();
+		while(!groundStation.hasReceivedPacket() && responseTimer.elapsed_time() < responseTimeout)
+		{}
+
+		// First edge is the transponder receiving the ground station's sync word, second is it sending its own
+		if(rangingTimer.hasSeenTransmission() && rangingTimer.hasReceivedResponse())
+		{
+			roundtripTimes[numTurnarounds++] = (rangingTimer.getRxCapturedTime() - rangingTimer.getTxCapturedTime()).count();
+		}
+
+		if(groundStation.hasReceivedPacket())
+		{
+			groundStation.receivePacket(packetBuffer, packetBufferLen);
+		}
+		if(transponder.hasReceivedPacket())
+		{
+			transponder.receivePacket(packetBuffer, packetBufferLen);
+		}
+
+		if(preloaded)
+		{
+			preloadedTransponder.rearm();
+		}
+	}
+
+	const auto runTime = runTimer.elapsed_time();
+
+	pc.printf("%zu turnarounds captured in %zu exchanges, %.01f exchanges/s\n", numTurnarounds, numAttempts,
+		numAttempts / chrono::duration_cast<chrono::duration<float>>(runTime).count());
+	if(preloaded)
+	{
+		pc.printf("FIFO rewinds that needed a refill: %zu\n", preloadedTransponder.getNumRearmFailures());
+	}
+
+	if(numTurnarounds < numTrials)
+	{
+		pc.printf(">> ERROR: Too many failed exchanges to measure the turnaround\n");
+		return;
+	}
+
+	QuickStats<int64_t, numTrials> stats(roundtripTimes);
+	pc.printf("Average Turnaround: %.00f ns\n", stats.average);
 	pc.printf("Jitter: +-%" PRIu64 " ns\n", (stats.maxVal - stats.minVal) / 2);
 	pc.printf("Standard Deviation: %.00f ns\n", stats.stdDeviation);
+	printHistogram(roundtripTimes.data(), numTrials, stats.minVal, stats.maxVal);
+
+	measuredTurnaround = static_cast<int64_t>(stats.average);
+}
+
+// This test measures the transponder's RX-sync-to-TX-sync turnaround, first when writing the response
+// before every exchange and then with the response preloaded in the FIFO.
+// The ground station's GPIOs are held low, so only the transponder's sync output reaches the ranging timer.
+void checkTransponderTurnaround()
+{
+	pc.printf("Initializing CC1200s.....\n");
+	txRadio.begin();
+	rxRadio.begin();
+	rangingTimer.begin();
 
+	pc.printf("Configuring RF settings.....\n");
+
+	RadioSettings groundStationSettings = loadOrAskForRadioSettings(pc, rxRadio, configStore, 0);
+	RadioSettings transponderSettings = loadOrAskForRadioSettings(pc, txRadio, configStore, 1);
+	offerToSaveSettings(pc, configStore);
+
+	CC1200 & groundStation = std::ref(rxRadio);
+	CC1200 & transponder = std::ref(txRadio);
+
+	configureRangingRadios(groundStation, transponder);
+
+	groundStation.configureGPIO(0, CC1200::GPIOMode::HW0);
+	groundStation.configureGPIO(2, CC1200::GPIOMode::HW0);
+	transponder.configureGPIO(2, CC1200::GPIOMode::PKT_SYNC_RXTX);
+
+	pc.printf("\nResponse written before every exchange:\n");
+	measureTurnaround(groundStation, transponder, groundStationSettings, transponderSettings, false);
+
+	pc.printf("\nPreloaded response:\n");
+	measureTurnaround(groundStation, transponder, groundStationSettings, transponderSettings, true);
 }
 
 // This test checks the ranging timer RX radio sync capture input.
@@ -241,20 +691,55 @@ void checkRXTimerCapture()
 	}
 }
 
+void clearSavedSettings()
+{
+	if(configStore.clear())
+	{
+		pc.printf(">> Saved settings cleared.\n");
+	}
+	else
+	{
+		pc.printf(">> ERROR: Failed to clear saved settings\n");
+	}
+}
+
 int main()
 {
 	pc.printf("\nHamster Radio Test Suite:\n");
 
+	// If settings were saved along with a test, run it straight away
+	int savedTest = -1;
+	if(configStore.load())
+	{
+		savedTest = configStore.getTestSelection();
+		pc.printf(">> Running saved test %d.  Use option 7 to clear the saved settings.\n", savedTest);
+	}
+
+	// Tests shouldn't need the heap from here on
+	MemoryBudget::lockHeap();
+
 	while(1){
-		int test=-1;
+		int test=savedTest;
+		savedTest = -1;
 		//MENU. ADD AN OPTION FOR EACH TEST.
 		pc.printf("Select a test: \n");
 		pc.printf("1.  Exit Test Suite\n");
 		pc.printf("2.  Check Existance\n");
 		pc.printf("3.  Check Transmitting Signal\n");
 		pc.printf("4.  Check RX timer capture\n");
+		pc.printf("5.  Compare standard and minimal ranging frames\n");
+		pc.printf("6.  Check transponder turnaround\n");
+		pc.printf("7.  Clear saved settings\n");
 
-		pc.scanf("%d", &test);
+		if(test == -1)
+		{
+			pc.scanf("%d", &test);
+		}
+		if(!configStore.isLoaded())
+		{
+			// saved along with the radio settings, if the test offers to save them
+			configStore.setTestSelection(test);
+		}
 		printf("Running test %d:\n\n", test);
 		//SWITCH. ADD A CASE FOR EACH TEST.
 		switch(test) {
@@ -262,8 +747,16 @@ int main()
 			case 2:         checkExistance();              break;
 			case 3:         checkSignalTransmit();              break;
 			case 4:         checkRXTimerCapture();              break;
+			case 5:         compareRangingFrames();              break;
+			case 6:         checkTransponderTurnaround();              break;
+			case 7:         clearSavedSettings();              break;
 			default:        pc.printf("Invalid test number. Please run again.\n"); continue;
 		}
+
+		char testName[16];
+		snprintf(testName, sizeof(testName), "test %d", test);
+		MemoryBudget::printReport(pc, testName);
+
 		pc.printf("done.\r\n");
 	}
 
@@ -0,0 +1,302 @@
+//
+// Fixed size, multi-resolution history of measurements, for correlating fades with failures over long soak tests.
+//
+
+#ifndef LIGHTSPEEDRANGEFINDER_TIMESERIESSTORE_H
+#define LIGHTSPEEDRANGEFINDER_TIMESERIESSTORE_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+#include "Checksum.h"
+
+/**
+ * Keeps the history of a few channels of measurements (e.g. RSSI, LQI and link quality) at three resolutions:
+ * 1ms, 100ms and 10s buckets.  Each bucket holds the min, max and mean of each channel, plus the number of samples.
+ *
+ * Samples go into the current 1ms bucket.  When a bucket finishes, it's saved in that tier's ring buffer and
+ * merged into the current bucket of the next tier up, so appending is a few compares and adds.
+ * Time with no samples shows up as empty buckets.  Once a ring buffer is full, its oldest buckets are overwritten.
+ *
+ * Memory use is fixed at (FINE_LEN + MEDIUM_LEN + COARSE_LEN) * (2 + 3 * NUM_CHANNELS * sizeof(T)) bytes, plus a little.
+ *
+ * @tparam T Sample type, stored as is in the buckets.  Must fit in 16 bits for exportTier().
+ * @tparam NUM_CHANNELS Number of values in each sample
+ * @tparam FINE_LEN Number of 1ms buckets kept
+ * @tparam MEDIUM_LEN Number of 100ms buckets kept
+ * @tparam COARSE_LEN Number of 10s buckets kept
+ */
+template<typename T, size_t NUM_CHANNELS, size_t FINE_LEN, size_t MEDIUM_LEN, size_t COARSE_LEN>
+class TimeSeriesStore
+{
+public:
+
+	static constexpr size_t NUM_TIERS = 3;
+
+	typedef std::array<T, NUM_CHANNELS> Sample;
+
+	struct Bucket
+	{
+		uint16_t count; // number of samples, 0 if the bucket is empty
+		T min[NUM_CHANNELS];
+		T max[NUM_CHANNELS];
+		T mean[NUM_CHANNELS];
+	};
+
+	TimeSeriesStore()
+	{
+		static_assert(sizeof(T) <= 2, "Samples must fit in 16 bits for export");
+		clear();
+	}
+
+	/**
+	 * @return Length of each bucket in a tier.  Tier 0 is the finest.
+	 */
+	static constexpr std::chrono::milliseconds getPeriod(size_t tier)
+	{
+		return std::chrono::milliseconds(tier == 0 ? 1 : (tier == 1 ? 100 : 10000));
+	}
+
+	/**
+	 * @return Number of buckets a tier can hold
+	 */
+	static constexpr size_t getCapacity(size_t tier)
+	{
+		return tier == 0 ? FINE_LEN : (tier == 1 ? MEDIUM_LEN : COARSE_LEN);
+	}
+
+	/**
+	 * Erase all history.
+	 */
+	void clear()
+	{
+		for(size_t tier = 0; tier < NUM_TIERS; ++tier)
+		{
+			tiers[tier].head = 0;
+			tiers[tier].size = 0;
+			tiers[tier].current.started = false;
+			tiers[tier].current.count = 0;
+		}
+	}
+
+	/**
+	 * Add a sample.
+	 * @param time Time of the sample, e.g. from a Timer started at boot.  Must not go backwards.
+	 */
+	void append(std::chrono::milliseconds time, Sample const & sample)
+	{
+		Accumulator single;
+		single.started = false;
+		single.number = 0;
+		single.count = 1;
+		for(size_t channel = 0; channel < NUM_CHANNELS; ++channel)
+		{
+			single.min[channel] = sample[channel];
+			single.max[channel] = sample[channel];
+			single.sum[channel] = sample[channel];
+		}
+		addToTier(0, time.count(), single);
+	}
+
+	/**
+	 * @return Number of finished buckets in a tier.  The bucket still being filled isn't included.
+	 */
+	size_t getNumBuckets(size_t tier) const
+	{
+		return tiers[tier].size;
+	}
+
+	/**
+	 * Get a finished bucket.
+	 * @param age 0 for the newest bucket, up to getNumBuckets() - 1 for the oldest
+	 */
+	Bucket const & getBucket(size_t tier, size_t age) const
+	{
+		Tier const & tierData = tiers[tier];
+		const size_t capacity = getCapacity(tier);
+		return storage[getOffset(tier) + (tierData.head + capacity - 1 - age) % capacity];
+	}
+
+	/**
+	 * @return Bucket number (time / period) of the newest finished bucket in a tier
+	 */
+	uint32_t getNewestBucketNumber(size_t tier) const
+	{
+		return tiers[tier].newestNumber;
+	}
+
+	/**
+	 * Export one tier's finished buckets as a binary frame (all values little endian):
+	 *   0xA5 0x54                       sync
+	 *   uint8   tier
+	 *   uint8   number of channels (C)
+	 *   uint32  bucket period, ms
+	 *   uint32  bucket number of the newest bucket (its start time is this times the period)
+	 *   uint16  number of buckets (N)
+	 *   N * { uint16 count, C * int16 min, C * int16 max, C * int16 mean }, oldest first
+	 *   uint16  CRC-16/CCITT of everything between the sync word and the CRC
+	 *
+	 * The frame is written in small pieces, so no buffer is needed for the whole thing.
+	 * @param write Called with (uint8_t const * data, size_t len) for each piece, e.g. to write it to a serial port
+	 */
+	template<typename Writer>
+	void exportTier(size_t tier, Writer && write) const
+	{
+		const uint8_t sync[2] = {0xA5, 0x54};
+		write(sync, sizeof(sync));
+
+		uint8_t header[14];
+		size_t offset = 0;
+		header[offset++] = static_cast<uint8_t>(tier);
+		header[offset++] = static_cast<uint8_t>(NUM_CHANNELS);
+		offset = putLE<uint32_t>(header, offset, static_cast<uint32_t>(getPeriod(tier).count()));
+		offset = putLE<uint32_t>(header, offset, tiers[tier].newestNumber);
+		offset = putLE<uint16_t>(header, offset, static_cast<uint16_t>(tiers[tier].size));
+		write(header, offset);
+		uint16_t crc = crc16CCITT(header, offset);
+
+		uint8_t bucketBuffer[2 + 6 * NUM_CHANNELS];
+		for(size_t age = tiers[tier].size; age > 0; --age)
+		{
+			Bucket const & bucket = getBucket(tier, age - 1);
+
+			offset = putLE<uint16_t>(bucketBuffer, 0, bucket.count);
+			for(T const * values : {bucket.min, bucket.max, bucket.mean})
+			{
+				for(size_t channel = 0; channel < NUM_CHANNELS; ++channel)
+				{
+					offset = putLE<uint16_t>(bucketBuffer, offset, static_cast<uint16_t>(static_cast<int16_t>(values[channel])));
+				}
+			}
+			write(bucketBuffer, offset);
+			crc = crc16CCITT(bucketBuffer, offset, crc);
+		}
+
+		uint8_t crcBuffer[2];
+		putLE<uint16_t>(crcBuffer, 0, crc);
+		write(crcBuffer, sizeof(crcBuffer));
+	}
+
+private:
+
+	/**
+	 * Bucket that's still being filled.  Keeps the sum instead of the mean so buckets can be merged exactly.
+	 */
+	struct Accumulator
+	{
+		bool started;
+		uint32_t number;
+		uint32_t count;
+		T min[NUM_CHANNELS];
+		T max[NUM_CHANNELS];
+		float sum[NUM_CHANNELS];
+	};
+
+	struct Tier
+	{
+		size_t head; // index where the next bucket goes
+		size_t size;
+		uint32_t newestNumber;
+		Accumulator current;
+	};
+
+	Tier tiers[NUM_TIERS];
+	Bucket storage[FINE_LEN + MEDIUM_LEN + COARSE_LEN];
+
+	static constexpr size_t getOffset(size_t tier)
+	{
+		return tier == 0 ? 0 : (tier == 1 ? FINE_LEN : FINE_LEN + MEDIUM_LEN);
+	}
+
+	template<typename Value>
+	static size_t putLE(uint8_t * buffer, size_t offset, Value value)
+	{
+		for(size_t byteIndex = 0; byteIndex < sizeof(Value); ++byteIndex)
+		{
+			buffer[offset++] = static_cast<uint8_t>(value >> (8 * byteIndex));
+		}
+		return offset;
+	}
+
+	/**
+	 * Merge samples into a tier, finishing the current bucket first if they belong in a later one.
+	 * @param timeMs Time of the samples, or start time of the bucket they came from
+	 */
+	void addToTier(size_t tier, int64_t timeMs, Accumulator const & samples)
+	{
+		Accumulator & current = tiers[tier].current;
+		const uint32_t number = static_cast<uint32_t>(timeMs / getPeriod(tier).count());
+
+		if(current.started && number != current.number)
+		{
+			finishBucket(tier);
+
+			// fill in the time with no samples, no point going round the ring more than once
+			uint32_t emptyNumber = current.number + 1;
+			if(number - emptyNumber > getCapacity(tier))
+			{
+				emptyNumber = number - getCapacity(tier);
+			}
+			for(; emptyNumber < number; ++emptyNumber)
+			{
+				pushBucket(tier, Bucket{}, emptyNumber);
+			}
+		}
+
+		if(!current.started || number != current.number)
+		{
+			current = samples;
+			current.started = true;
+			current.number = number;
+			return;
+		}
+
+		for(size_t channel = 0; channel < NUM_CHANNELS; ++channel)
+		{
+			current.min[channel] = samples.min[channel] < current.min[channel] ? samples.min[channel] : current.min[channel];
+			current.max[channel] = samples.max[channel] > current.max[channel] ? samples.max[channel] : current.max[channel];
+			current.sum[channel] += samples.sum[channel];
+		}
+		current.count += samples.count;
+	}
+
+	/**
+	 * Save the current bucket of a tier and pass it up to the next one.
+	 */
+	void finishBucket(size_t tier)
+	{
+		Accumulator const & current = tiers[tier].current;
+
+		Bucket bucket;
+		bucket.count = static_cast<uint16_t>(current.count > UINT16_MAX ? UINT16_MAX : current.count);
+		for(size_t channel = 0; channel < NUM_CHANNELS; ++channel)
+		{
+			bucket.min[channel] = current.min[channel];
+			bucket.max[channel] = current.max[channel];
+			bucket.mean[channel] = static_cast<T>(current.sum[channel] / current.count);
+		}
+		pushBucket(tier, bucket, current.number);
+
+		if(tier + 1 < NUM_TIERS)
+		{
+			addToTier(tier + 1, static_cast<int64_t>(current.number) * getPeriod(tier).count(), current);
+		}
+	}
+
+	void pushBucket(size_t tier, Bucket const & bucket, uint32_t number)
+	{
+		Tier & tierData = tiers[tier];
+		storage[getOffset(tier) + tierData.head] = bucket;
+		tierData.head = (tierData.head + 1) % getCapacity(tier);
+		if(tierData.size < getCapacity(tier))
+		{
+			++tierData.size;
+		}
+		tierData.newestNumber = number;
+	}
+};
+
+#endif //LIGHTSPEEDRANGEFINDER_TIMESERIESSTORE_H
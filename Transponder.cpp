@@ -0,0 +1,55 @@
+//
+// Transponder mode which keeps its response staged in the TX FIFO.
+//
+
+#include "Transponder.h"
+
+PreloadedTransponder::PreloadedTransponder(CC1200 & radio):
+radio(radio),
+response(nullptr),
+responseLen(0),
+fifoBytes(0),
+numRearmFailures(0)
+{
+}
+
+bool PreloadedTransponder::preload(char const * newResponse, size_t newResponseLen)
+{
+	response = newResponse;
+	responseLen = newResponseLen;
+
+	radio.sendCommand(CC1200::Command::FLUSH_TX);
+	if(!radio.enqueuePacket(response, responseLen))
+	{
+		fifoBytes = 0;
+		return false;
+	}
+
+	// depends on the packet mode, so read it back rather than working it out
+	fifoBytes = radio.getTXFIFOLen();
+	return true;
+}
+
+bool PreloadedTransponder::rearm()
+{
+	// The FIFO starts at address 0 after a flush, so the packet always starts there.
+	// Sending it only moves TXFIRST up to TXLAST, the data is still there.
+	radio.writeRegister(CC1200::ExtRegister::TXFIRST, 0);
+
+	if(isArmed())
+	{
+		return true;
+	}
+
+	// flushing only works in idle, so briefly drop out of RX
+	++numRearmFailures;
+	radio.idle();
+	preload(response, responseLen);
+	radio.startRX();
+	return false;
+}
+
+bool PreloadedTransponder::isArmed()
+{
+	return fifoBytes > 0 && radio.getTXFIFOLen() == fifoBytes;
+}
@@ -0,0 +1,60 @@
+//
+// Transponder mode which keeps its response staged in the TX FIFO.
+//
+
+#ifndef LIGHTSPEEDRANGEFINDER_TRANSPONDER_H
+#define LIGHTSPEEDRANGEFINDER_TRANSPONDER_H
+
+#include <CC1200.h>
+
+/**
+ * Drives a transponder radio which always has its response ready to go.
+ *
+ * The response is written to the TX FIFO once.  After each exchange, instead of writing the packet again
+ * over SPI, the TX FIFO's read pointer (TXFIRST) is moved back to the start of the packet, so the radio
+ * sends the same bytes again.  The radio must be set up to go RX -> TX on receiving a packet
+ * and TX -> RX when done, like in TestJitter.
+ */
+class PreloadedTransponder
+{
+public:
+	explicit PreloadedTransponder(CC1200 & radio);
+
+	/**
+	 * Stage the response.  Flushes anything already in the TX FIFO, so the radio must be idle.
+	 * @param response Must stay valid while the transponder is in use, since it's used to refill the FIFO if rearming fails
+	 * @return false if the response couldn't be written to the FIFO
+	 */
+	bool preload(char const * response, size_t responseLen);
+
+	/**
+	 * Rewind the TX FIFO so the response gets sent again on the next exchange.
+	 * Call once the previous response has been sent, when the radio is back in RX.
+	 * If the FIFO doesn't hold the response afterwards (e.g. because it was flushed), it is written again.
+	 * @return false if the FIFO had to be refilled
+	 */
+	bool rearm();
+
+	/**
+	 * @return Whether the response is staged and will be sent on the next received packet
+	 */
+	bool isArmed();
+
+	/**
+	 * @return Number of times rearm() found the FIFO in a bad state
+	 */
+	size_t getNumRearmFailures() const { return numRearmFailures; }
+
+private:
+	CC1200 & radio;
+
+	char const * response;
+	size_t responseLen;
+
+	// bytes the packet takes up in the FIFO, including the length byte
+	size_t fifoBytes;
+
+	size_t numRearmFailures;
+};
+
+#endif //LIGHTSPEEDRANGEFINDER_TRANSPONDER_H